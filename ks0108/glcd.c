@@ -26,6 +26,8 @@
 #include <util/delay.h>
 #endif
 
+#include <string.h>
+
 #include "glcd.h"
 
 // include hardware support
@@ -37,52 +39,118 @@
 
 // graphic routines
 
-// set dot
-void glcdSetDot(u08 x, u08 y) {
-  unsigned char temp;
-  
-  glcdSetAddress(x, y/8);
-  glcdDataRead(1);
-  temp = glcdDataRead(0);
-  
-  glcdSetAddress(x, y/8);
-  glcdDataWrite(temp | _BV(y % 8));
-  
-  glcdStartLine(0);
+// the drawing primitives collect the bits to be changed in the column
+// bytes of one page. these are then read and written in bursts instead
+// of a read-modify-write cycle for every single dot
+#define GLCD_SPAN_MAX	16
+
+static struct {
+  u08 x, page, n, mode;
+  u08 mask[GLCD_SPAN_MAX];
+} glcdSpan;
+
+static void glcdSpanFlush(void)
+{
+  u08 data[GLCD_SPAN_MAX];
+  u08 i, j, n, x, m, full;
+
+  for(i = 0; i < glcdSpan.n; i += n) {
+    // the controller's read pipeline doesn't continue on the next one
+    x = glcdSpan.x + i;
+    n = GLCD_CONTROLLER_XPIXELS - (x % GLCD_CONTROLLER_XPIXELS);
+    if(n > glcdSpan.n - i)
+      n = glcdSpan.n - i;
+
+    // bytes set or cleared completely don't need to be read
+    full = (glcdSpan.mode != GLCD_MODE_XOR);
+    for(j = 0; j < n; j++)
+      if(glcdSpan.mask[i + j] != 0xff)
+	full = 0;
+
+    if(!full) {
+      glcdSetAddress(x, glcdSpan.page);
+      glcdDataRead(1);	// dummy read
+      for(j = 0; j < n; j++)
+	data[j] = glcdDataRead(0);
+    }
+
+    // the new bytes are written in one burst
+    glcdSetAddress(x, glcdSpan.page);
+    if(full) {
+      glcdDataWriteRepeat((glcdSpan.mode == GLCD_MODE_CLEAR) ? 0x00 : 0xff, n);
+      continue;
+    }
+
+    for(j = 0; j < n; j++) {
+      m = glcdSpan.mask[i + j];
+      if(glcdSpan.mode == GLCD_MODE_CLEAR)
+	data[j] &= ~m;
+      else if(glcdSpan.mode == GLCD_MODE_XOR)
+	data[j] ^= m;
+      else
+	data[j] |= m;
+    }
+    glcdDataWriteBurst(data, n);
+  }
+
+  glcdSpan.n = 0;
 }
 
-// clear dot
-void glcdClearDot(u08 x, u08 y) {
-  unsigned char temp;
-  
-  glcdSetAddress(x, y/8);
-  glcdDataRead(1);	// dummy read
-  temp = glcdDataRead(0);	// read back current value
-  
-  glcdSetAddress(x, y/8);
-  glcdDataWrite(temp & ~_BV(y % 8));
+// add bits of the column byte x of a page to the current span
+static void glcdSpanBits(u08 x, u08 page, u08 bits)
+{
+  u08 i;
+
+  if(glcdSpan.n && page == glcdSpan.page) {
+    if(x >= glcdSpan.x && x < glcdSpan.x + glcdSpan.n) {
+      i = x - glcdSpan.x;
+      goto apply;
+    }
+
+    // extend the span by a neighbouring byte
+    if(glcdSpan.n < GLCD_SPAN_MAX) {
+      if(x == glcdSpan.x + glcdSpan.n) {
+	i = glcdSpan.n++;
+	glcdSpan.mask[i] = 0;
+	goto apply;
+      }
+      if(x + 1 == glcdSpan.x) {
+	memmove(glcdSpan.mask + 1, glcdSpan.mask, glcdSpan.n++);
+	glcdSpan.x = x;
+	glcdSpan.mask[i = 0] = 0;
+	goto apply;
+      }
+    }
+  }
+
+  glcdSpanFlush();
+  glcdSpan.x = x;
+  glcdSpan.page = page;
+  glcdSpan.n = 1;
+  glcdSpan.mask[i = 0] = 0;
 
-  glcdStartLine(0);
+ apply:
+  // inverting a dot twice leaves it unchanged like it did dot by dot
+  if(glcdSpan.mode == GLCD_MODE_XOR)
+    glcdSpan.mask[i] ^= bits;
+  else
+    glcdSpan.mask[i] |= bits;
 }
 
-// change (invert) dot
-void glcdChangeDot(u08 x, u08 y) {
-  unsigned char temp;
-  
-  glcdSetAddress(x, y/8);
-  glcdDataRead(1);	// dummy read
-  temp = glcdDataRead(0);	// read back current value
-  
-  glcdSetAddress(x, y/8);
-  glcdDataWrite(temp ^ _BV(y % 8));
-  
-  glcdStartLine(0);
+// dots outside the display are skipped. the coordinates are checked
+// as ints, since sums like x + width may exceed a u08
+static void glcdSpanDot(int x, int y)
+{
+  if(x >= 0 && x < GLCD_XPIXELS && y >= 0 && y < GLCD_YPIXELS)
+    glcdSpanBits(x, y/8, _BV(y % 8));
 }
 
 // draw line
-void glcdLine(void(*draw)(u08,u08), u08 x1, u08 y1, u08 x2, u08 y2) {
+void glcdLine(u08 mode, u08 x1, u08 y1, u08 x2, u08 y2) {
   int dx, dy, inx, iny, e;
-       
+
+  glcdSpan.mode = mode;
+
   dx = x2 - x1;
   dy = y2 - y1;
   inx = dx > 0 ? 1 : -1;
@@ -96,7 +164,7 @@ void glcdLine(void(*draw)(u08,u08), u08 x1, u08 y1, u08 x2, u08 y2) {
     e = dy - dx;
     dx <<= 1;
     while (x1 != x2) {
-      draw(x1, y1);
+      glcdSpanDot(x1, y1);
       if(e >= 0) {
 	y1 += iny;
 	e-= dx;
@@ -108,7 +176,7 @@ void glcdLine(void(*draw)(u08,u08), u08 x1, u08 y1, u08 x2, u08 y2) {
     e = dx - dy;
     dy <<= 1;
     while (y1 != y2) {
-      draw(x1, y1);
+      glcdSpanDot(x1, y1);
       if(e >= 0) {
 	x1 += inx;
 	e -= dy;
@@ -116,52 +184,106 @@ void glcdLine(void(*draw)(u08,u08), u08 x1, u08 y1, u08 x2, u08 y2) {
       e += dx; y1 += iny;
     }
   }
-  draw(x1, y1);
+  glcdSpanDot(x1, y1);
+  glcdSpanFlush();
 }
 
-// draw rectangle
-void glcdRectangle(u08 x, u08 y, u08 a, u08 b)
+// draw rectangle outline of height a and width b, every dot exactly once
+void glcdRectangle(u08 mode, u08 x, u08 y, u08 a, u08 b)
 {
   unsigned char j;
 
-  for (j = 0; j < a; j++) {
-		glcdSetDot(x, y + j);
-		glcdSetDot(x + b - 1, y + j);
-	}
-  for (j = 0; j < b; j++)	{
-		glcdSetDot(x + j, y);
-		glcdSetDot(x + j, y + a - 1);
-	}
+  if(!a || !b)
+    return;
+
+  glcdSpan.mode = mode;
+
+  for (j = 0; j < a; j++)
+    glcdSpanDot(x, y + j);
+  if(b > 1)
+    for (j = 0; j < a; j++)
+      glcdSpanDot(x + b - 1, y + j);
+  for (j = 1; j < b - 1; j++)
+    glcdSpanDot(x + j, y);
+  if(a > 1)
+    for (j = 1; j < b - 1; j++)
+      glcdSpanDot(x + j, y + a - 1);
+
+  glcdSpanFlush();
 }
 
-// draw circle
-void glcdCircle(u08 xcenter, u08 ycenter, u08 radius)
+// fill rectangle of height a and width b, clipped to the display. the
+// area is drawn page by page, so each column byte is accessed only once
+void glcdFillRectangle(u08 mode, u08 x, u08 y, u08 a, u08 b)
 {
-  int tswitch, y, x = 0;
-  unsigned char d;
-
-  d = ycenter - xcenter;
-  y = radius;
-  tswitch = 3 - 2 * radius;
-  while (x <= y) {
-    glcdSetDot(xcenter + x, ycenter + y);     glcdSetDot(xcenter + x, ycenter - y);
-    glcdSetDot(xcenter - x, ycenter + y);     glcdSetDot(xcenter - x, ycenter - y);
-    glcdSetDot(ycenter + y - d, ycenter + x); glcdSetDot(ycenter + y - d, ycenter - x);
-    glcdSetDot(ycenter - y - d, ycenter + x); glcdSetDot(ycenter - y - d, ycenter - x);
-
-    if (tswitch < 0) tswitch += (4 * x + 6);
-    else {
-      tswitch += (4 * (x - y) + 10);
-      y--;
+  unsigned int i, top, bottom;
+  u08 page, bits;
+
+  top = y;
+  bottom = (y + a < GLCD_YPIXELS) ? y + a : GLCD_YPIXELS;
+  if(!b || top >= bottom)
+    return;
+
+  glcdSpan.mode = mode;
+
+  for (page = top/8; page <= (bottom - 1)/8; page++) {
+    // rows of this page within the rectangle
+    bits = 0xff;
+    if(page == top/8)
+      bits &= 0xff << (top % 8);
+    if(page == (bottom - 1)/8)
+      bits &= 0xff >> (7 - (bottom - 1) % 8);
+
+    for (i = x; i < x + b && i < GLCD_XPIXELS; i++)
+      glcdSpanBits(i, page, bits);
+  }
+
+  glcdSpanFlush();
+}
+
+// draw circle. the eight octants are drawn one after the other, so
+// neighbouring dots end up in the same span. dots on the borders
+// between the octants are drawn only once. the dots are computed as
+// ints and those outside the display are skipped by glcdSpanDot()
+void glcdCircle(u08 mode, u08 xcenter, u08 ycenter, u08 radius)
+{
+  int tswitch, y, x, a, b;
+  u08 octant;
+
+  glcdSpan.mode = mode;
+
+  for (octant = 0; octant < 8; octant++) {
+    x = 0;
+    y = radius;
+    tswitch = 3 - 2 * radius;
+    while (x <= y) {
+      a = x;
+      b = y;
+      if(octant & 4) {
+	a = y;
+	b = x;
+      }
+
+      if(!((octant & 4) && x == y) && !((octant & 1) && !a) && !((octant & 2) && !b))
+	glcdSpanDot((octant & 1) ? xcenter - a : xcenter + a,
+		    (octant & 2) ? ycenter - b : ycenter + b);
+
+      if (tswitch < 0) tswitch += (4 * x + 6);
+      else {
+	tswitch += (4 * (x - y) + 10);
+	y--;
+      }
+      x++;
     }
-    x++;
   }
+
+  glcdSpanFlush();
 }
 
 // text routines
 
-// write a character at the current position
-void glcdWriteChar(unsigned char c)
+// write the 6 columns of a character at the current position
+void glcdWriteGlyph(unsigned char c)
 {
 	u08 i = 0;
 
@@ -172,6 +294,12 @@ void glcdWriteChar(unsigned char c)
 
 	// write a spacer line
 	glcdDataWrite(0x00);
+}
+
+// write a character at the current position
+void glcdWriteChar(unsigned char c)
+{
+	glcdWriteGlyph(c);
 	// unless we're at the end of the display
 	//if(xx == 128)
 	//	xx = 0;
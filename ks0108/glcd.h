@@ -59,28 +59,31 @@
 // API-level interface commands
 // ***** Public Functions *****
 
-//! set a dot on the display (x is horiz 0:127, y is vert 0:63)
-void glcdSetDot(u08 x, u08 y);
-
-//! clear a dot on the display (x is horiz 0:127, y is vert 0:63)
-void glcdClearDot(u08 x, u08 y);
-
-//! change (revert/xor) a dot on the display (x is horiz 0:127, y is vert 0:63)
-void glcdChangeDot(u08 x, u08 y);
+// modes of the drawing primitives below. dots outside the display
+// are skipped
+#define GLCD_MODE_SET		0
+#define GLCD_MODE_CLEAR		1
+#define GLCD_MODE_XOR		2
 
 //! draw line
-void glcdLine(void(*draw)(u08,u08), u08 x1, u08 y1, u08 x2, u08 y2);
+void glcdLine(u08 mode, u08 x1, u08 y1, u08 x2, u08 y2);
 
-//! draw rectangle (coords????)
-void glcdRectangle(u08 x, u08 y, u08 a, u08 b);
+//! draw outline of rectangle at <x,y> of height <a> and width <b>
+void glcdRectangle(u08 mode, u08 x, u08 y, u08 a, u08 b);
+
+//! fill rectangle at <x,y> of height <a> and width <b>
+void glcdFillRectangle(u08 mode, u08 x, u08 y, u08 a, u08 b);
 
 //! draw circle of <radius> at <xcenter,ycenter>
-void glcdCircle(u08 xcenter, u08 ycenter, u08 radius);
+void glcdCircle(u08 mode, u08 xcenter, u08 ycenter, u08 radius);
 
 //! write a standard ascii charater (values 20-127)
 // to the display at current position
 void glcdWriteChar(unsigned char c);
 
+//! same as glcdWriteChar() but leaves the display start line alone
+void glcdWriteGlyph(unsigned char c);
+
 //! write a special graphic character/icon
 // to the display at current position
 void glcdWriteCharGr(u08 grCharIndex);
@@ -26,13 +26,34 @@
 #include <util/delay.h>
 #endif
 
+#include <string.h>
+
 #include "global.h"
 #include "ks0108.h"
 
+#ifndef NOP
 #define NOP  asm volatile ("nop")
+#endif
 
 // global variables
 GrLcdStateType GrLcdState;
+GrLcdGeometryType glcdGeometry = { GLCD_CONTROLLERS, GLCD_CS_TABLE };
+
+#ifdef GLCD_SHADOW
+// copy of the display memory. all data reads and writes go here and
+// only glcdFlush() transfers the changed parts to the controllers
+u08 glcdShadow[GLCD_YPIXELS/8][GLCD_MAX_XPIXELS];
+// per page and controller range of columns changed since the last
+// flush, counted from the controller's first column
+static u08 glcdDirtyStart[GLCD_YPIXELS/8][GLCD_MAX_CONTROLLERS];
+static u08 glcdDirtyEnd[GLCD_YPIXELS/8][GLCD_MAX_CONTROLLERS];
+#endif
+
+// bytes to be written to each controller at its current address
+static struct {
+  const u08 *data;
+  u08 len;
+} glcdRun[GLCD_MAX_CONTROLLERS];
 
 /*************************************************************/
 /********************** LOCAL FUNCTIONS **********************/
@@ -42,22 +63,17 @@ void glcdInitHW(void) {
   // initialize I/O ports
   // if I/O interface is in use
   
-  //TODO: make setup of chip select lines contingent on how
-  // many controllers are actually in the display
-  
   // initialize LCD control lines levels
   cbi(GLCD_CTRL_PORT, GLCD_CTRL_RS);
   cbi(GLCD_CTRL_PORT, GLCD_CTRL_RW);
   cbi(GLCD_CTRL_PORT, GLCD_CTRL_E);
-  cbi(GLCD_CTRL_PORT, GLCD_CTRL_CS0);
-  cbi(GLCD_CTRL_PORT, GLCD_CTRL_CS1);
+  GLCD_CTRL_PORT &= ~GLCD_CS_MASK;
   cbi(GLCD_CTRL_PORT, GLCD_CTRL_RESET);
   // initialize LCD control port to output
   sbi(GLCD_CTRL_DDR, GLCD_CTRL_RS);
   sbi(GLCD_CTRL_DDR, GLCD_CTRL_RW);
   sbi(GLCD_CTRL_DDR, GLCD_CTRL_E);
-  sbi(GLCD_CTRL_DDR, GLCD_CTRL_CS0);
-  sbi(GLCD_CTRL_DDR, GLCD_CTRL_CS1);
+  GLCD_CTRL_DDR |= GLCD_CS_MASK;
   sbi(GLCD_CTRL_DDR, GLCD_CTRL_RESET);
   // initialize LCD data
   outb(GLCD_DATA_PORT, 0x00);
@@ -68,13 +84,8 @@ void glcdInitHW(void) {
 void glcdControllerSelect(u08 controller)
 {
   // select requested controller
-  if(!controller) {
-    sbi(GLCD_CTRL_PORT, GLCD_CTRL_CS0);
-    cbi(GLCD_CTRL_PORT, GLCD_CTRL_CS1);
-  } else {
-    cbi(GLCD_CTRL_PORT, GLCD_CTRL_CS0);
-    sbi(GLCD_CTRL_PORT, GLCD_CTRL_CS1);
-  }
+  GLCD_CTRL_PORT = (GLCD_CTRL_PORT & ~GLCD_CS_MASK) | 
+    glcdGeometry.cs[controller];
 }
 
 void glcdBusyWait(u08 controller) {
@@ -129,38 +140,261 @@ u08 glcdControlRead(u08 controller) {
   return data;
 }
 
+// write len bytes to the selected controller at its current address.
+// the controller stays selected and between the bytes only the busy
+// flag is polled. a step of 0 writes the same byte len times
+static void glcdBusBurst(u08 controller, const u08 *data, u08 len, u08 step) {
+  u08 n;
+
+  glcdControllerSelect(controller);
+
+  for(n = len; n; n--, data += step) {
+    // wait until LCD not busy
+    outb(GLCD_DATA_PORT, 0x00);  // no pullups
+    outb(GLCD_DATA_DDR, 0x00);
+    cbi(GLCD_CTRL_PORT, GLCD_CTRL_RS);
+    sbi(GLCD_CTRL_PORT, GLCD_CTRL_RW);
+    sbi(GLCD_CTRL_PORT, GLCD_CTRL_E);
+    NOP; NOP; NOP; NOP;
+    NOP; NOP; NOP; NOP;
+
+    while(inb(GLCD_DATA_PIN) & (GLCD_STATUS_BUSY | GLCD_STATUS_RESET));
+
+    cbi(GLCD_CTRL_PORT, GLCD_CTRL_E);
+    cbi(GLCD_CTRL_PORT, GLCD_CTRL_RW);
+    outb(GLCD_DATA_DDR, 0xFF);
+    outb(GLCD_DATA_PORT, *data);
+    sbi(GLCD_CTRL_PORT, GLCD_CTRL_RS);
+    sbi(GLCD_CTRL_PORT, GLCD_CTRL_E);
+
+    NOP; NOP; NOP; NOP;
+    NOP; NOP; NOP; NOP;
+
+    cbi(GLCD_CTRL_PORT, GLCD_CTRL_E);
+  }
+
+  // the controller increments its column counter after each write
+  GrLcdState.ctrlr[controller].xAddr = 
+    (GrLcdState.ctrlr[controller].xAddr+len) % GLCD_CONTROLLER_XPIXELS;
+}
+
+// write the runs of all controllers. the controllers get one byte
+// after the other, so each one's busy time passes while the others
+// are written. a run left alone is written in one burst
+static void glcdBusInterleave(u08 step) {
+  u08 controller, active, last = 0;
+
+  for(;;) {
+    active = 0;
+    for(controller=0; controller<GLCD_NUM_CONTROLLERS; controller++)
+      if(glcdRun[controller].len) {
+	active++;
+	last = controller;
+      }
+
+    if(active <= 1)
+      break;
+
+    for(controller=0; controller<GLCD_NUM_CONTROLLERS; controller++)
+      if(glcdRun[controller].len) {
+	glcdBusBurst(controller, glcdRun[controller].data, 1, step);
+	glcdRun[controller].data += step;
+	glcdRun[controller].len--;
+      }
+  }
+
+  if(active) {
+    glcdBusBurst(last, glcdRun[last].data, glcdRun[last].len, step);
+    glcdRun[last].len = 0;
+  }
+}
+
+// send page and column commands to a controller, but only if the
+// address cached for it differs from the requested one
+static void glcdSyncAddress(u08 controller, u08 x, u08 page) {
+  x %= GLCD_CONTROLLER_XPIXELS;
+
+  if(GrLcdState.ctrlr[controller].yAddr != page) {
+    glcdControlWrite(controller, GLCD_SET_PAGE | page);
+    GrLcdState.ctrlr[controller].yAddr = page;
+  }
+
+  if(GrLcdState.ctrlr[controller].xAddr != x) {
+    glcdControlWrite(controller, GLCD_SET_Y_ADDR | x);
+    GrLcdState.ctrlr[controller].xAddr = x;
+  }
+}
+
+// forget the cached controller addresses, the next access will
+// set them again
+static void glcdInvalidateAddress(void) {
+  u08 controller;
+
+  for(controller=0; controller<GLCD_NUM_CONTROLLERS; controller++)
+    GrLcdState.ctrlr[controller].xAddr = 
+      GrLcdState.ctrlr[controller].yAddr = GLCD_ADDR_INVALID;
+}
+
+// advance the local address counter like the controllers would. the
+// address is compared first since it wraps itself on 256 pixel panels
+static void glcdNextAddress(void) {
+  if(GrLcdState.lcdXAddr >= GLCD_XPIXELS-1) {
+    GrLcdState.lcdXAddr = 0;
+    GrLcdState.lcdYAddr = (GrLcdState.lcdYAddr+1) % (GLCD_YPIXELS/8);
+  } else
+    GrLcdState.lcdXAddr++;
+}
+
+#ifdef GLCD_SHADOW
+
 void glcdDataWrite(u08 data) {
-  register u08 controller = (GrLcdState.lcdXAddr/GLCD_CONTROLLER_XPIXELS);
-	
-  glcdBusyWait(controller);		// wait until LCD not busy
-  
-  outb(GLCD_DATA_DDR, 0xFF);
-  outb(GLCD_DATA_PORT, data);
-  
-  sbi(GLCD_CTRL_PORT, GLCD_CTRL_RS);
-  cbi(GLCD_CTRL_PORT, GLCD_CTRL_RW);
-  sbi(GLCD_CTRL_PORT, GLCD_CTRL_E);
-  
-  NOP; NOP; NOP; NOP;
-  NOP; NOP; NOP; NOP;
-  
-  cbi(GLCD_CTRL_PORT, GLCD_CTRL_E);
-  
-  
-  // increment our local address counter
-  GrLcdState.ctrlr[controller].xAddr++;
-  GrLcdState.lcdXAddr++;
-  if(GrLcdState.lcdXAddr >= GLCD_XPIXELS) {
-    glcdSetYAddress(GrLcdState.lcdYAddr+1);
-    glcdSetXAddress(0);
+  register u08 page = GrLcdState.lcdYAddr;
+  register u08 x = GrLcdState.lcdXAddr;
+  register u08 controller = x/GLCD_CONTROLLER_XPIXELS;
+  register u08 col = x%GLCD_CONTROLLER_XPIXELS;
+
+  if(glcdShadow[page][x] != data) {
+    glcdShadow[page][x] = data;
+
+    // extend the area to be flushed
+    if(col < glcdDirtyStart[page][controller]) 
+      glcdDirtyStart[page][controller] = col;
+    if(col >= glcdDirtyEnd[page][controller])  
+      glcdDirtyEnd[page][controller] = col+1;
+  }
+
+  glcdNextAddress();
+}
+
+u08 glcdDataRead(u08 dummy) {
+  register u08 data;
+
+  // no pipeline to be emptied when reading from ram
+  if(dummy) return 0;
+
+  data = glcdShadow[GrLcdState.lcdYAddr][GrLcdState.lcdXAddr];
+  glcdNextAddress();
+  return data;
+}
+
+u08 glcdFlushPart(u08 count) {
+  u08 page[GLCD_MAX_CONTROLLERS];
+  u08 controller, active, share, p, x, n;
+
+  // each controller works through its own pages, so the
+  // changes of all controllers can be written interleaved
+  memset(page, 0, sizeof(page));
+
+  for(;;) {
+    active = 0;
+    for(controller=0; controller<GLCD_NUM_CONTROLLERS; controller++) {
+      for(p = page[controller]; p < (GLCD_YPIXELS>>3); p++)
+	if(glcdDirtyStart[p][controller] < glcdDirtyEnd[p][controller])
+	  break;
+
+      if((page[controller] = p) < (GLCD_YPIXELS>>3))
+	active++;
+    }
+
+    if(!active)
+      return 0;
+
+    if(!count)
+      return 1;
+
+    // the bytes to be written are shared among the controllers
+    share = count / active;
+    if(!share) share = 1;
+
+    for(controller=0; controller<GLCD_NUM_CONTROLLERS && count; controller++) {
+      if((p = page[controller]) >= (GLCD_YPIXELS>>3))
+	continue;
+
+      // the start of the dirty area moves along with the transfer
+      x = glcdDirtyStart[p][controller];
+      n = glcdDirtyEnd[p][controller] - x;
+      if(n > share) n = share;
+      if(n > count) n = count;
+
+      glcdSyncAddress(controller, x, p);
+      glcdRun[controller].data = 
+	&glcdShadow[p][controller*GLCD_CONTROLLER_XPIXELS + x];
+      glcdRun[controller].len = n;
+      count -= n;
+
+      if((glcdDirtyStart[p][controller] += n) >= glcdDirtyEnd[p][controller]) {
+	glcdDirtyStart[p][controller] = GLCD_CONTROLLER_XPIXELS;
+	glcdDirtyEnd[p][controller] = 0;
+      }
+    }
+
+    glcdBusInterleave(1);
   }
 }
 
+void glcdFlush(void) {
+  while(glcdFlushPart(0xff));
+}
+
+// the panel is only written by the flush, which does the bursts
+static void glcdBurst(const u08 *data, u16 len, u08 step) {
+  for(; len; len--, data += step)
+    glcdDataWrite(*data);
+}
+#else
+// write to the panel in one run per controller, the local address
+// is advanced once per run. runs for different controllers are
+// written interleaved
+static void glcdBurst(const u08 *data, u16 len, u08 step) {
+  u08 controller, n;
+
+  while(len) {
+    // split the data at the controller boundaries until a controller
+    // would get a second run
+    while(len) {
+      controller = GrLcdState.lcdXAddr/GLCD_CONTROLLER_XPIXELS;
+      if(glcdRun[controller].len)
+	break;
+
+      // bytes up to the end of the controller or the line
+      n = GLCD_CONTROLLER_XPIXELS - 
+	(GrLcdState.lcdXAddr % GLCD_CONTROLLER_XPIXELS);
+      if(n > GLCD_XPIXELS - GrLcdState.lcdXAddr)
+	n = GLCD_XPIXELS - GrLcdState.lcdXAddr;
+      if(n > len)
+	n = len;
+
+      glcdSyncAddress(controller, GrLcdState.lcdXAddr, GrLcdState.lcdYAddr);
+      glcdRun[controller].data = data;
+      glcdRun[controller].len = n;
+      data += n*step;
+      len -= n;
+
+      if(GrLcdState.lcdXAddr + n >= GLCD_XPIXELS) {
+	GrLcdState.lcdXAddr = 0;
+	GrLcdState.lcdYAddr = (GrLcdState.lcdYAddr+1) % (GLCD_YPIXELS/8);
+      } else
+	GrLcdState.lcdXAddr += n;
+    }
+
+    glcdBusInterleave(step);
+  }
+}
+
+void glcdDataWrite(u08 data) {
+  glcdBurst(&data, 1, 0);
+}
+
 u08 glcdDataRead(u08 dummy)
 {
   register u08 data;
   register u08 controller = (GrLcdState.lcdXAddr/GLCD_CONTROLLER_XPIXELS);
 
+  // the dummy read starts the read pipeline at the current address,
+  // the following read must not change the address anymore
+  if(dummy)
+    glcdSyncAddress(controller, GrLcdState.lcdXAddr, GrLcdState.lcdYAddr);
+
   glcdBusyWait(controller);		// wait until LCD not busy
 
   outb(GLCD_DATA_PORT, 0x00); // no pullups
@@ -177,17 +411,30 @@ u08 glcdDataRead(u08 dummy)
   GLCD_CTRL_PORT &= ~(_BV(GLCD_CTRL_RS) | 
 		      _BV(GLCD_CTRL_RW) | _BV(GLCD_CTRL_E));
 
-  if(!dummy) {
-    // increment our local address counter, not done for dummy reads
-    GrLcdState.ctrlr[controller].xAddr++;
-    GrLcdState.lcdXAddr++;
-    if(GrLcdState.lcdXAddr >= GLCD_XPIXELS) {
-      glcdSetYAddress(GrLcdState.lcdYAddr+1);
-      glcdSetXAddress(0);
-    }
-  }
+  // the controller advances its column on reads as well, so the
+  // cached column is of no use anymore
+  GrLcdState.ctrlr[controller].xAddr = GLCD_ADDR_INVALID;
+
+  // increment our local address counter, not done for dummy reads
+  if(!dummy)
+    glcdNextAddress();
+
   return data;
 }
+#endif
+
+void glcdDataWriteBurst(const u08 *data, u08 len) {
+  glcdBurst(data, len, 1);
+}
+
+void glcdDataWriteRepeat(u08 data, u16 len) {
+  glcdBurst(&data, len, 0);
+}
+
+void glcdWriteBurst(u08 x, u08 page, const u08 *data, u08 len) {
+  glcdSetAddress(x, page);
+  glcdBurst(data, len, 1);
+}
 
 void glcdReset(u08 resetState)
 {
@@ -202,40 +449,39 @@ void glcdReset(u08 resetState)
 
 void glcdSetXAddress(u08 xAddr)
 {
-	// record address change locally
+	// record address change locally, the controllers are only
+	// updated on the next data access
 	GrLcdState.lcdXAddr = xAddr;
-	
-	glcdControlWrite(0, GLCD_SET_Y_ADDR);
-	GrLcdState.ctrlr[0].xAddr = 0;
-	glcdControlWrite(1, GLCD_SET_Y_ADDR);
-	GrLcdState.ctrlr[1].xAddr = 0;
-
-	// set y (col) address on destination controller
-	glcdControlWrite((GrLcdState.lcdXAddr/GLCD_CONTROLLER_XPIXELS),
-		GLCD_SET_Y_ADDR | (GrLcdState.lcdXAddr & 0x3F));
 }
 
 void glcdSetYAddress(u08 yAddr) {
   // record address change locally
   GrLcdState.lcdYAddr = yAddr;
-  // set page address for all controllers
-  glcdControlWrite(0, GLCD_SET_PAGE | yAddr);
-  glcdControlWrite(1, GLCD_SET_PAGE | yAddr);
 }
 
 /*************************************************************/
 /********************* PUBLIC FUNCTIONS **********************/
 /*************************************************************/
 
+void glcdSetGeometry(u08 controllers, const u08 *cs)
+{
+	glcdGeometry.controllers = controllers;
+	memcpy(glcdGeometry.cs, cs, controllers);
+}
+
 void glcdInit()
 {
+	u08 controller;
+
 	// initialize hardware
 	glcdInitHW();
+	// controller addresses are unknown after reset
+	glcdInvalidateAddress();
 	// bring lcd out of reset
 	glcdReset(FALSE);
 	// Turn on LCD
-	glcdControlWrite(0, GLCD_ON_CTRL | GLCD_ON_DISPLAY);
-	glcdControlWrite(1, GLCD_ON_CTRL | GLCD_ON_DISPLAY);
+	for(controller=0; controller<GLCD_NUM_CONTROLLERS; controller++)
+		glcdControlWrite(controller, GLCD_ON_CTRL | GLCD_ON_DISPLAY);
 	// clear lcd
 	glcdClearScreen();
 	// initialize positions
@@ -248,33 +494,46 @@ void glcdHome(void)
 	glcdStartLine(0);
 	glcdSetAddress(0,0);
 	// initialize local data structures
-	GrLcdState.ctrlr[0].xAddr = GrLcdState.ctrlr[0].yAddr = 0;
-	GrLcdState.ctrlr[1].xAddr = GrLcdState.ctrlr[1].yAddr = 0;
+	glcdInvalidateAddress();
 }
 
 void glcdClearScreen(void)
 {
 	u08 pageAddr;
-	u08 xAddr;
 
+#ifdef GLCD_SHADOW
+	u08 controller;
+
+	// the controller memory contents are unknown (e.g. after power
+	// up), so the entire display is written during the flush
+	memset(glcdShadow, 0, sizeof(glcdShadow));
+	for(pageAddr=0; pageAddr<(GLCD_YPIXELS>>3); pageAddr++)
+	{
+		for(controller=0; controller<GLCD_NUM_CONTROLLERS; controller++)
+		{
+			glcdDirtyStart[pageAddr][controller] = 0;
+			glcdDirtyEnd[pageAddr][controller] = GLCD_CONTROLLER_XPIXELS;
+		}
+	}
+	glcdFlush();
+#else
 	// clear LCD
 	// loop through all pages
 	for(pageAddr=0; pageAddr<(GLCD_YPIXELS>>3); pageAddr++)
 	{
-		// set page address
-		glcdSetAddress(0, pageAddr);
 		// clear all lines of this page of display memory
-		for(xAddr=0; xAddr<GLCD_XPIXELS; xAddr++)
-		{
-			glcdDataWrite(0x00);
-		}
+		glcdSetAddress(0, pageAddr);
+		glcdDataWriteRepeat(0x00, GLCD_XPIXELS);
 	}
+#endif
 }
 
 void glcdStartLine(u08 start)
 {
-  glcdControlWrite(0, GLCD_START_LINE | start);
-  glcdControlWrite(1, GLCD_START_LINE | start);
+  u08 controller;
+
+  for(controller=0; controller<GLCD_NUM_CONTROLLERS; controller++)
+    glcdControlWrite(controller, GLCD_START_LINE | start);
 }
 
 void glcdSetAddress(u08 x, u08 yLine) {
@@ -58,9 +58,13 @@
 #define GLCD_STATUS_ONOFF	0x20	// (0)->LCD IS ON
 #define GLCD_STATUS_RESET	0x10	// (1)->LCD IS RESET
 
-// determine the number of controllers
-// (make sure we round up for partial use of more than one controller)
-#define GLCD_NUM_CONTROLLERS	((GLCD_XPIXELS+GLCD_CONTROLLER_XPIXELS-1)/GLCD_CONTROLLER_XPIXELS)
+// number of controllers and display width as set up at runtime
+#define GLCD_NUM_CONTROLLERS	(glcdGeometry.controllers)
+#define GLCD_XPIXELS	((u16)GLCD_NUM_CONTROLLERS*GLCD_CONTROLLER_XPIXELS)
+#define GLCD_MAX_XPIXELS	(GLCD_MAX_CONTROLLERS*GLCD_CONTROLLER_XPIXELS)
+
+// cached controller address that never matches a real one
+#define GLCD_ADDR_INVALID	0xff
 
 // typedefs/structures
 typedef struct struct_GrLcdCtrlrStateType
@@ -73,9 +77,17 @@ typedef struct struct_GrLcdStateType
 {
 	unsigned char lcdXAddr;
 	unsigned char lcdYAddr;
-	GrLcdCtrlrStateType ctrlr[GLCD_NUM_CONTROLLERS];
+	GrLcdCtrlrStateType ctrlr[GLCD_MAX_CONTROLLERS];
 } GrLcdStateType;
 
+typedef struct struct_GrLcdGeometryType
+{
+	unsigned char controllers;		// controllers from left to right
+	unsigned char cs[GLCD_CS_ENTRIES];	// their chip select patterns
+} GrLcdGeometryType;
+
+extern GrLcdGeometryType glcdGeometry;
+
 // function prototypes
 void glcdInitHW(void);
 void glcdBusyWait(u08 controller);
@@ -85,8 +97,17 @@ void glcdDataWrite(u08 data);
 u08  glcdDataRead(u08 dummy);
 void glcdSetXAddress(u08 xAddr);
 void glcdSetYAddress(u08 yAddr);
+//! Write [len] bytes at the current address like glcdDataWrite() does
+void glcdDataWriteBurst(const u08 *data, u08 len);
+//! Write the byte [data] [len] times at the current address
+void glcdDataWriteRepeat(u08 data, u16 len);
+//! Write [len] bytes to [page] starting at horizontal pixel [x]
+void glcdWriteBurst(u08 x, u08 page, const u08 *data, u08 len);
 
 
+//! Use [controllers] controllers selected by the patterns [cs] on the
+//! chip select lines, glcdInit() has to be called afterwards
+void glcdSetGeometry(u08 controllers, const u08 *cs);
 //! Initialize the display, clear it, and prepare it for access
 void glcdInit(void);
 //! Clear the display
@@ -101,4 +122,13 @@ void glcdSetAddress(u08 x, u08 yLine);
 void glcdStartLine(u08 start);
 //! Generic delay routine for timed glcd access
 void glcdDelay(u16 p);
+
+#ifdef GLCD_SHADOW
+//! Transfer all changes made to the display memory mirror to the display
+void glcdFlush(void);
+//! Transfer up to count changed bytes, returns 1 if changes are left
+u08 glcdFlushPart(u08 count);
+#else
+#define glcdFlush()
+#endif
 #endif
@@ -32,19 +32,45 @@
 #define GLCD_CTRL_E	PA5	// pin for LCD Enable
 #define GLCD_CTRL_CS0	PA4	// pin for LCD Controller 0 Chip Select
 #define GLCD_CTRL_CS1	PA3	// pin for LCD Controller 1 Chip Select(*)
+#define GLCD_CTRL_CS2	PA2	// pin for LCD Controller 2 Chip Select(*)
+#define GLCD_CTRL_CS3	PA1	// pin for LCD Controller 3 Chip Select(*)
 #define GLCD_CTRL_RESET	PA0	// pin for LCD Reset
 // (*) NOTE: additonal controller chip selects are optional and 
 // will be automatically used per each step in 64 pixels of display size
 // Example: Display with 128 hozizontal pixels uses 2 controllers
+
+// chip select lines and their state while a controller is accessed,
+// one entry per controller. panels decoding the chip selects from
+// two lines e.g. use { _BV(GLCD_CTRL_CS1), _BV(GLCD_CTRL_CS0),
+// _BV(GLCD_CTRL_CS0)|_BV(GLCD_CTRL_CS1) } for their 3 controllers
+#define GLCD_CS_MASK	(_BV(GLCD_CTRL_CS0) | _BV(GLCD_CTRL_CS1) | \
+			 _BV(GLCD_CTRL_CS2) | _BV(GLCD_CTRL_CS3))
+#define GLCD_CS_TABLE	{ _BV(GLCD_CTRL_CS0), _BV(GLCD_CTRL_CS1), \
+			  _BV(GLCD_CTRL_CS2), _BV(GLCD_CTRL_CS3) }
+#define GLCD_CS_ENTRIES	4	// size of the table
 #define GLCD_DATA_PORT	PORTC	// PORT for LCD data signals
 #define GLCD_DATA_DDR	DDRC	// DDR register of LCD_DATA_PORT
 #define GLCD_DATA_PIN	PINC	// PIN register of LCD_DATA_PORT
 
 // LCD geometry defines (change these definitions to adapt code/settings)
-#define GLCD_XPIXELS	128		// pixel width of entire display
+// the number of controllers and thus the display width can also be
+// set in eeprom (see main.c), GLCD_XPIXELS is determined at runtime
+#ifndef GLCD_CONTROLLERS
+#define GLCD_CONTROLLERS	2	// default number of display controllers
+#endif
 #define GLCD_YPIXELS	64		// pixel height of entire display
 #define GLCD_CONTROLLER_XPIXELS	64	// pixel width of one display controller
 
+// number of controllers memory is reserved for. the display memory
+// mirror takes 512 bytes per controller
+#ifndef GLCD_MAX_CONTROLLERS
+#ifdef GLCD_SHADOW
+#define GLCD_MAX_CONTROLLERS	2
+#else
+#define GLCD_MAX_CONTROLLERS	4
+#endif
+#endif
+
 // Set text size of display
 // These definitions are not currently used and will probably move to glcd.h
 #define GLCD_TEXT_LINES           8     // visible lines
@@ -35,12 +35,21 @@
 /* display specific includes */
 #include "ks0108.h"
 
+/* frames can only be held back with the display memory mirror */
+#ifdef GLCD_SHADOW
+#define FLAGS2  FLAG2_COMMIT
+#else
+#define FLAGS2  0
+#endif
+
 /* this drivers info */
 static const display_info_t display_info PROGMEM = {
   GLCD2USB_RID_GET_INFO,
   "KS0108",
   128, 64,
-  FLAG_VERTICAL_UNITS | FLAG_BACKLIGHT
+  FLAG_VERTICAL_UNITS | FLAG_BACKLIGHT | FLAG_RLE | FLAG_BUTTON_EVENTS |
+  FLAG_MULTI,
+  FLAG2_SCROLL | FLAG2_TEXT | FLAG2_DRAW | FLAG2_CRC | FLAG2_KEEP | FLAGS2
 };
 
 #define USB_HID_REPORT_TYPE_INPUT   1
@@ -113,6 +122,12 @@ const PROGMEM char usbHidReportDescriptor[USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH]
     0x09, 0x00,                    //   USAGE (Undefined)
     0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
 
+    /* button changes are also sent via the interrupt endpoint */
+    0x85, GLCD2USB_RID_GET_BUTTONS,//   REPORT_ID
+    0x95, 1,                       //   REPORT_COUNT (1)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0x82, 0x02, 0x01,              //   INPUT (Data,Var,Abs,Buf)
+
     0x85, GLCD2USB_RID_SET_BL,     //   REPORT_ID
     0x95, 1,                       //   REPORT_COUNT (1)
     0x09, 0x00,                    //   USAGE (Undefined)
@@ -148,6 +163,51 @@ const PROGMEM char usbHidReportDescriptor[USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH]
     0x09, 0x00,                    //   USAGE (Undefined)
     0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
 
+    0x85, GLCD2USB_RID_WRITE_RLE_16, // REPORT_ID
+    0x95, 16+3,                    //   REPORT_COUNT (19)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+
+    0x85, GLCD2USB_RID_WRITE_RLE_64, // REPORT_ID
+    0x95, 64+3,                    //   REPORT_COUNT (67)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+
+    0x85, GLCD2USB_RID_WRITE_MULTI_64, // REPORT_ID
+    0x95, 64+3,                    //   REPORT_COUNT (67)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+
+    0x85, GLCD2USB_RID_WRITE_MULTI_128, // REPORT_ID
+    0x95, 128+3,                   //   REPORT_COUNT (131)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+
+    0x85, GLCD2USB_RID_COMMIT,     //   REPORT_ID
+    0x95, 1,                       //   REPORT_COUNT (1)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+
+    0x85, GLCD2USB_RID_SCROLL,     //   REPORT_ID
+    0x95, 1,                       //   REPORT_COUNT (1)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+
+    0x85, GLCD2USB_RID_TEXT,       //   REPORT_ID
+    0x95, 64+3,                    //   REPORT_COUNT (67)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+
+    0x85, GLCD2USB_RID_DRAW,       //   REPORT_ID
+    0x95, GLCD2USB_DRAW_SIZE,      //   REPORT_COUNT (32)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+
+    0x85, GLCD2USB_RID_GET_CRC,    //   REPORT_ID
+    0x95, 2*GLCD2USB_CRC_PAGES,    //   REPORT_COUNT (32)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+
     0xc0                           // END_COLLECTION
 };
 
@@ -157,6 +217,8 @@ void whirl_enable(char on);
 
 typedef struct {
   unsigned short magic;
+  uchar controllers;                 /* panel width in units of 64 pixels */
+  uchar cs[GLCD_CS_ENTRIES];         /* chip select patterns, see ks0108conf.h */
 } config_t;
 
 #define EEPROM_MAGIC  0x4711
@@ -166,7 +228,7 @@ static const config_t config EEMEM;
 
 /* the following default will be copied to eeprom on initial boot */
 static const config_t config_default PROGMEM = {
-  EEPROM_MAGIC,
+  EEPROM_MAGIC, GLCD_CONTROLLERS, GLCD_CS_TABLE
 };
 
 uchar button_map;
@@ -185,10 +247,336 @@ void keyPressed(void) {
   button_map |= (~PINB & 0x0f);
 }
 
+void keySendEvent(void) {
+  static uchar button_sent;
+  uchar event[2];
+
+  /* send the button map whenever it differs from what the host */
+  /* has seen last. a release is only visible in the current */
+  /* button state since the button map remembers the presses */
+  if(usbInterruptIsReady() && 
+     (button_map != button_sent || (~PINB & 0x0f) != button_sent)) {
+    event[0] = GLCD2USB_RID_GET_BUTTONS;
+    event[1] = button_sent = button_map_get();
+    usbSetInterrupt(event, sizeof(event));
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ command fifo ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* usbFunctionWrite() only decodes the reports into display commands. */
+/* these are queued and executed from the main loop, so the usb */
+/* packet handling never has to wait for the display */
+#define FIFO_SIZE    128    /* must be a power of two */
+#define FIFO_PACKET  (3*8)  /* each received byte adds at most 3 bytes */
+#define FIFO_DRAIN   16     /* display writes per main loop iteration */
+#define FIFO_NONE    0xff
+
+#define FIFO_CMD_ADDRESS  0  /* x, page */
+#define FIFO_CMD_DATA     1  /* n, n data bytes */
+#define FIFO_CMD_REPEAT   2  /* n, data byte to be written n times */
+#define FIFO_CMD_ALLOC    3  /* 1=alloc, 0=free, opt. keeping the contents */
+#define FIFO_CMD_COMMIT   4  /* 1=hold frames, 0=show writes immediately */
+#define FIFO_CMD_SCROLL   5  /* display start line */
+#define FIFO_CMD_TEXT     6  /* character drawn with the built-in font */
+#define FIFO_CMD_DRAW     7  /* drawing command and its coordinates */
+#define FIFO_CMD_CRC      8  /* start computing the crcs */
+
+struct {
+  uchar buffer[FIFO_SIZE];
+  uchar head, tail, used;
+  uchar data;        /* length byte of the open data command */
+} fifo;
+
+/* while frames are held, writes only go to the display memory mirror. */
+/* a commit transfers them to the display before the next frame's */
+/* commands are taken from the fifo */
+struct {
+  uchar hold;        /* only show committed frames */
+  uchar commit;      /* committed frame is being transferred */
+  uchar scroll;      /* start line to be set with the next commit */
+  uchar start;
+} frame;
+
+/* the crcs of the display memory are requested by a set report. they */
+/* are computed from the main loop once the commands received before */
+/* have been executed, one display page per iteration. meanwhile the */
+/* host has to wait (NAK), then it fetches them with a get report */
+#define CRC_IDLE     0
+#define CRC_QUEUED   1  /* the commands before are still executed */
+#define CRC_RUNNING  2
+
+struct {
+  uchar state;
+  uchar page;        /* next display page read */
+  unsigned short crc, offset;
+  uchar report[1 + 2*GLCD2USB_CRC_PAGES];
+} crc_state;
+
+static void fifo_put(uchar c) {
+  fifo.buffer[fifo.head] = c;
+  fifo.head = (fifo.head + 1) & (FIFO_SIZE-1);
+  fifo.used++;
+}
+
+static uchar fifo_get(void) {
+  uchar c = fifo.buffer[fifo.tail];
+  fifo.tail = (fifo.tail + 1) & (FIFO_SIZE-1);
+  fifo.used--;
+  return c;
+}
+
+/* anything left to do for the display? */
+uchar fifo_busy(void) {
+  return fifo.used || frame.commit || crc_state.state != CRC_IDLE;
+}
+
+static void fifo_address(unsigned short offset) {
+  fifo.data = FIFO_NONE;
+  fifo_put(FIFO_CMD_ADDRESS);
+  fifo_put(offset % GLCD_XPIXELS);
+  fifo_put(offset / GLCD_XPIXELS);
+}
+
+/* consecutive data bytes share one command */
+static void fifo_data(uchar c) {
+  if(fifo.data == FIFO_NONE) {
+    fifo_put(FIFO_CMD_DATA);
+    fifo.data = fifo.head;
+    fifo_put(0);
+  }
+
+  fifo.buffer[fifo.data]++;
+  fifo_put(c);
+}
+
+static void fifo_repeat(uchar n, uchar c) {
+  fifo.data = FIFO_NONE;
+  fifo_put(FIFO_CMD_REPEAT);
+  fifo_put(n);
+  fifo_put(c);
+}
+
+static void fifo_alloc(uchar on) {
+  fifo.data = FIFO_NONE;
+  fifo_put(FIFO_CMD_ALLOC);
+  fifo_put(on);
+}
+
+static void fifo_commit(uchar hold) {
+  fifo.data = FIFO_NONE;
+  fifo_put(FIFO_CMD_COMMIT);
+  fifo_put(hold);
+}
+
+static void fifo_scroll(uchar start) {
+  fifo.data = FIFO_NONE;
+  fifo_put(FIFO_CMD_SCROLL);
+  fifo_put(start);
+}
+
+static void fifo_text(uchar c) {
+  fifo.data = FIFO_NONE;
+  fifo_put(FIFO_CMD_TEXT);
+  fifo_put(c);
+}
+
+static void fifo_draw(uchar *cmd) {
+  uchar i;
+
+  fifo.data = FIFO_NONE;
+  fifo_put(FIFO_CMD_DRAW);
+  for(i = 0; i <= GLCD2USB_DRAW_ARGS(cmd[0]); i++)
+    fifo_put(cmd[i]);
+}
+
+static void fifo_crc(void) {
+  fifo.data = FIFO_NONE;
+  fifo_put(FIFO_CMD_CRC);
+}
+
+static void draw_command(uchar cmd, uchar *arg) {
+  /* the protocol's modes are the glcd modes shifted into the upper nibble */
+  u08 mode = (cmd & GLCD2USB_DRAW_MODE) >> 4;
+
+  switch(cmd & GLCD2USB_DRAW_PRIMITIVE) {
+  case GLCD2USB_DRAW_LINE:
+    glcdLine(mode, arg[0], arg[1], arg[2], arg[3]);
+    break;
+
+  case GLCD2USB_DRAW_RECT:
+    glcdRectangle(mode, arg[0], arg[1], arg[3], arg[2]);
+    break;
+
+  case GLCD2USB_DRAW_FILL:
+    glcdFillRectangle(mode, arg[0], arg[1], arg[3], arg[2]);
+    break;
+
+  case GLCD2USB_DRAW_CIRCLE:
+    glcdCircle(mode, arg[0], arg[1], arg[2]);
+    break;
+  }
+}
+
+/* execute queued commands. only complete commands are executed, */
+/* but not much more than FIFO_DRAIN bytes are written at once */
+void fifo_process(void) {
+  uchar n, c, written = 0;
+
+  while(fifo.used && written < FIFO_DRAIN) {
+    switch(fifo_get()) {
+    case FIFO_CMD_ADDRESS:
+      c = fifo_get();
+      glcdSetAddress(c, fifo_get());
+      break;
+
+    case FIFO_CMD_DATA:
+      written += n = fifo_get();
+
+      /* the data is written directly from the fifo, in two bursts */
+      /* if it wraps around the end of the buffer */
+      c = FIFO_SIZE - fifo.tail;
+      if(c > n)
+	c = n;
+      glcdDataWriteBurst(fifo.buffer + fifo.tail, c);
+      if(n > c)
+	glcdDataWriteBurst(fifo.buffer, n - c);
+
+      fifo.tail = (fifo.tail + n) & (FIFO_SIZE-1);
+      fifo.used -= n;
+      break;
+
+    case FIFO_CMD_REPEAT:
+      written += n = fifo_get();
+      glcdDataWriteRepeat(fifo_get(), n);
+      break;
+
+    case FIFO_CMD_ALLOC:
+      frame.hold = frame.scroll = 0;
+      c = fifo_get();
+
+      /* a restarting host may keep the display contents */
+      if(!(c & GLCD2USB_ALLOC_KEEP))
+	glcdInit();
+
+      if(c & GLCD2USB_ALLOC_ON) {
+	DEBUGF("-> allocate\n");
+	whirl_enable(0);
+      } else {
+	DEBUGF("-> free\n");
+	if(!(c & GLCD2USB_ALLOC_KEEP))
+	  whirl_init();
+      }
+      written = FIFO_DRAIN;
+      break;
+
+    case FIFO_CMD_COMMIT:
+      /* the panel is scrolled first, so only the exposed lines */
+      /* show old data while the frame is being transferred */
+      if(frame.scroll)
+	glcdStartLine(frame.start);
+      frame.scroll = 0;
+
+#ifdef GLCD_SHADOW
+      frame.hold = fifo_get();
+#else
+      fifo_get();
+#endif
+      frame.commit = 1;
+      written = FIFO_DRAIN;
+      break;
+
+    case FIFO_CMD_SCROLL:
+      frame.start = fifo_get() % GLCD_YPIXELS;
+      if(frame.hold)
+	frame.scroll = 1;
+      else
+	glcdStartLine(frame.start);
+      break;
+
+    case FIFO_CMD_TEXT:
+      /* the font only covers ascii 0x20-0x7f */
+      c = fifo_get();
+      if(c < 0x20 || c > 0x7f)
+	c = ' ';
+      glcdWriteGlyph(c);
+      written += 6;
+      break;
+
+    case FIFO_CMD_DRAW: {
+      uchar arg[4];
+
+      c = fifo_get();
+      for(n = 0; n < GLCD2USB_DRAW_ARGS(c); n++)
+	arg[n] = fifo_get();
+      draw_command(c, arg);
+      written = FIFO_DRAIN;
+      break;
+    }
+
+    case FIFO_CMD_CRC:
+      memset(crc_state.report, 0, sizeof(crc_state.report));
+      crc_state.report[0] = GLCD2USB_RID_GET_CRC;
+      crc_state.page = 0;
+      crc_state.offset = 0;
+      crc_state.crc = 0xffff;
+      crc_state.state = CRC_RUNNING;
+      written = FIFO_DRAIN;
+      break;
+    }
+  }
+
+  /* accept usb data again once there's room for another packet and */
+  /* no crcs are being computed */
+  if(usbAllRequestsAreDisabled() && crc_state.state == CRC_IDLE &&
+     FIFO_SIZE - fifo.used >= FIFO_PACKET)
+    usbEnableAllRequests();
+}
+
+/* crc of every 128 bytes of display memory. it's read back from the */
+/* controllers (or from their mirror) to also notice glitches. one */
+/* display page is read per call */
+static void crc_process(void) {
+  u16 x;
+  uchar n;
+
+  for(x = 0; x < GLCD_XPIXELS; x++) {
+    /* each controller needs a dummy read at its first column */
+    if(!(x % GLCD_CONTROLLER_XPIXELS)) {
+      glcdSetAddress(x, crc_state.page);
+      glcdDataRead(1);
+    }
+
+    crc_state.crc = glcd2usb_crc(crc_state.crc, glcdDataRead(0));
+
+    if(!(++crc_state.offset % GLCD2USB_CRC_PAGE)) {
+      n = crc_state.offset / GLCD2USB_CRC_PAGE;
+      if(n <= GLCD2USB_CRC_PAGES) {
+	crc_state.report[2*n - 1] = crc_state.crc & 0xff;
+	crc_state.report[2*n] = crc_state.crc >> 8;
+      }
+      crc_state.crc = 0xffff;
+    }
+  }
+
+  /* the report is complete, the host may fetch it */
+  if(++crc_state.page == GLCD_YPIXELS/8)
+    crc_state.state = CRC_IDLE;
+}
+
+/* ------------------------------------------------------------------------- */
+
 struct {
   uchar report_id;
   unsigned short offset;
   uchar len;
+  uchar rle_count;   /* bytes left in current rle chunk, 0 = expect control */
+  uchar rle_repeat;  /* current rle chunk is a repeat chunk */
+  uchar header;      /* multi write: segment header bytes received */
+  uchar text;        /* multi write segments contain characters */
+  uchar draw[5];     /* drawing command being received */
 } cmd_state;
 
 uchar	usbFunctionSetup(uchar data[8]) {
@@ -224,7 +612,50 @@ uchar	usbFunctionSetup(uchar data[8]) {
 	  /* more data to come */
 	  return 0xff;
 	  break;
+
+	case GLCD2USB_RID_WRITE_RLE_16:
+	case GLCD2USB_RID_WRITE_RLE_64:
+	  cmd_state.report_id = GLCD2USB_RID_WRITE_RLE;
+	  cmd_state.offset = 0xffff;
+	  cmd_state.rle_count = 0;
+
+	  /* more data to come */
+	  return 0xff;
+	  break;
+
+	case GLCD2USB_RID_WRITE_MULTI_64:
+	case GLCD2USB_RID_WRITE_MULTI_128:
+	  cmd_state.report_id = GLCD2USB_RID_WRITE_MULTI;
+	  cmd_state.offset = 0xffff;
+	  cmd_state.len = 0;
+	  cmd_state.header = 0;
+	  cmd_state.text = 0;
+
+	  /* more data to come */
+	  return 0xff;
+	  break;
+
+	/* same segment format, the data is drawn with the built-in font */
+	case GLCD2USB_RID_TEXT:
+	  cmd_state.report_id = GLCD2USB_RID_WRITE_MULTI;
+	  cmd_state.offset = 0xffff;
+	  cmd_state.len = 0;
+	  cmd_state.header = 0;
+	  cmd_state.text = 1;
+
+	  /* more data to come */
+	  return 0xff;
+	  break;
 	  
+	case GLCD2USB_RID_DRAW:
+	  cmd_state.report_id = GLCD2USB_RID_DRAW;
+	  cmd_state.offset = 0xffff;
+	  cmd_state.header = 0;
+
+	  /* more data to come */
+	  return 0xff;
+	  break;
+
 	case GLCD2USB_RID_SET_ALLOC:
 	  DEBUGF("-> set alloc\n");
 	  cmd_state.report_id = GLCD2USB_RID_SET_ALLOC;
@@ -233,10 +664,32 @@ uchar	usbFunctionSetup(uchar data[8]) {
 	  return 0xff;
 	  break;
 
+	case GLCD2USB_RID_COMMIT:
+	  cmd_state.report_id = GLCD2USB_RID_COMMIT;
+
+	  /* more data to come */
+	  return 0xff;
+	  break;
+
+	case GLCD2USB_RID_SCROLL:
+	  cmd_state.report_id = GLCD2USB_RID_SCROLL;
+
+	  /* more data to come */
+	  return 0xff;
+	  break;
+
 	case GLCD2USB_RID_SET_BL:
 	  DEBUGF("-> set backlight\n");
 	  cmd_state.report_id = GLCD2USB_RID_SET_BL;
 
+	  /* more data to come */
+	  return 0xff;
+	  break;
+
+	case GLCD2USB_RID_GET_CRC:
+	  DEBUGF("-> request crc\n");
+	  cmd_state.report_id = GLCD2USB_RID_GET_CRC;
+
 	  /* more data to come */
 	  return 0xff;
 	  break;
@@ -260,6 +713,7 @@ uchar	usbFunctionSetup(uchar data[8]) {
 	case GLCD2USB_RID_GET_INFO:
 	  DEBUGF("<- get display info\n");
 	  memcpy_P(reportBuffer, &display_info, sizeof(display_info_t));
+	  ((display_info_t*)reportBuffer)->width = GLCD_XPIXELS;
 	  return sizeof(display_info_t);
 	  break;
        
@@ -269,6 +723,12 @@ uchar	usbFunctionSetup(uchar data[8]) {
 	  reportBuffer[1] = button_map_get();
 	  return 2;
 	  break;
+
+	case GLCD2USB_RID_GET_CRC:
+	  DEBUGF("<- get crc\n");
+	  usbMsgPtr = crc_state.report;
+	  return sizeof(crc_state.report);
+	  break;
 	}
 
 	break;
@@ -311,36 +771,157 @@ uchar usbFunctionWrite(uchar *data, uchar len)
       len -= 4;
       
       /* set draw cursor */
-      glcdSetAddress(cmd_state.offset%128, cmd_state.offset/128);
+      fifo_address(cmd_state.offset);
     }
     
     i = (len > cmd_state.len)?cmd_state.len:len;
     cmd_state.len -= i;
     
     while(i--)
-      glcdDataWrite(*data++);
+      fifo_data(*data++);
 
     break;
 
-  case GLCD2USB_RID_SET_ALLOC:
-    if(data[1]) {
-      DEBUGF("-> allocate\n");
-      glcdInit();
-      whirl_enable(0);
-    } else {
-      DEBUGF("-> free\n");
-      glcdInit();
-      whirl_init();
+  case GLCD2USB_RID_WRITE_RLE:
+    if(cmd_state.offset == 0xffff) {
+    
+      /* fetch parameters */
+      cmd_state.offset = data[1] + 256*data[2];
+      cmd_state.len = data[3];
+      
+      data += 4;
+      len -= 4;
+      
+      /* set draw cursor */
+      fifo_address(cmd_state.offset);
+    }
+    
+    i = (len > cmd_state.len)?cmd_state.len:len;
+    cmd_state.len -= i;
+
+    /* chunks may be split over several usb packets */
+    while(i--) {
+      if(!cmd_state.rle_count) {
+	/* control byte */
+	cmd_state.rle_repeat = *data & GLCD2USB_RLE_REPEAT;
+	cmd_state.rle_count = (*data & ~GLCD2USB_RLE_REPEAT) + 1;
+      } else if(cmd_state.rle_repeat) {
+	fifo_repeat(cmd_state.rle_count, *data);
+	cmd_state.rle_count = 0;
+      } else {
+	fifo_data(*data);
+	cmd_state.rle_count--;
+      }
+      data++;
+    }
+
+    break;
+
+  case GLCD2USB_RID_WRITE_MULTI:
+    if(cmd_state.offset == 0xffff) {
+      /* skip report id */
+      data++;
+      len--;
+    }
+
+    /* segments may be split over several usb packets */
+    for(i = len; i; i--, data++) {
+      if(cmd_state.len) {
+	if(cmd_state.text)
+	  fifo_text(*data);
+	else
+	  fifo_data(*data);
+	cmd_state.len--;
+	continue;
+      }
+
+      switch(cmd_state.header) {
+      case 0:
+	cmd_state.offset = *data;
+	cmd_state.header++;
+	break;
+
+      case 1:
+	cmd_state.offset += 256 * *data;
+	cmd_state.header++;
+	break;
+
+      case 2:
+	/* a zero length ends the segment list, ignore the rest */
+	if(!*data) {
+	  cmd_state.header++;
+	  break;
+	}
+
+	cmd_state.len = *data;
+	cmd_state.header = 0;
+
+	/* set draw cursor */
+	fifo_address(cmd_state.offset);
+	break;
+      }
+    }
+
+    break;
+
+  case GLCD2USB_RID_DRAW:
+    if(cmd_state.offset == 0xffff) {
+      /* skip report id */
+      cmd_state.offset = 0;
+      data++;
+      len--;
     }
 
+    /* commands may be split over several usb packets. they are only */
+    /* queued once complete */
+    for(i = len; i && cmd_state.header != 0xff; i--, data++) {
+      /* a zero byte ends the command list, ignore the rest */
+      if(!cmd_state.header && (!*data || (*data & GLCD2USB_DRAW_PRIMITIVE) > GLCD2USB_DRAW_CIRCLE)) {
+	cmd_state.header = 0xff;
+	break;
+      }
+
+      cmd_state.draw[cmd_state.header++] = *data;
+      if(cmd_state.header > GLCD2USB_DRAW_ARGS(cmd_state.draw[0])) {
+	fifo_draw(cmd_state.draw);
+	cmd_state.header = 0;
+      }
+    }
+
+    break;
+
+  case GLCD2USB_RID_SET_ALLOC:
+    /* the display is initialized from the main loop */
+    fifo_alloc(data[1]);
+    break;
+
+  case GLCD2USB_RID_COMMIT:
+    fifo_commit(data[1]);
+    break;
+
+  case GLCD2USB_RID_SCROLL:
+    fifo_scroll(data[1]);
     break;
 
   case GLCD2USB_RID_SET_BL:
     DEBUGF("-> backlight %d\n", data[1]);
     OCR1AL = data[1];
     break;
+
+  case GLCD2USB_RID_GET_CRC:
+    /* the host waits until the crcs have been computed */
+    fifo_crc();
+    crc_state.state = CRC_QUEUED;
+    usbDisableAllRequests();
+    break;
   }
 
+  /* a command never continues in the next packet */
+  fifo.data = FIFO_NONE;
+
+  /* let the host wait until the main loop has made room again */
+  if(FIFO_SIZE - fifo.used < FIFO_PACKET)
+    usbDisableAllRequests();
     
   return len;
 }
@@ -406,13 +987,13 @@ void whirl_progress(void) {
   /* undraw oldest whirl */
   if(whirl_state.whirl[0].p[0].x >= 0) { 
     for(j=0;j<WHIRL_POINTS-1;j++) 
-      glcdLine(glcdChangeDot, 
+      glcdLine(GLCD_MODE_XOR, 
 	       whirl_state.whirl[0].p[j+0].x, 
 	       WHIRL_TOP+whirl_state.whirl[0].p[j+0].y, 
 	       whirl_state.whirl[0].p[j+1].x, 
 	       WHIRL_TOP+whirl_state.whirl[0].p[j+1].y);
 #if WHIRL_POINTS > 2
-    glcdLine(glcdChangeDot, 
+    glcdLine(GLCD_MODE_XOR, 
 	     whirl_state.whirl[0].p[WHIRL_POINTS-1].x, 
 	     WHIRL_TOP+whirl_state.whirl[0].p[WHIRL_POINTS-1].y, 
 	     whirl_state.whirl[0].p[0].x, 
@@ -450,13 +1031,13 @@ void whirl_progress(void) {
 
   /* draw new whirl */
   for(j=0;j<WHIRL_POINTS-1;j++) 
-    glcdLine(glcdChangeDot, 
+    glcdLine(GLCD_MODE_XOR, 
 	     whirl_state.whirl[WHIRLS-1].p[j+0].x, 
 	     WHIRL_TOP+whirl_state.whirl[WHIRLS-1].p[j+0].y, 
 	     whirl_state.whirl[WHIRLS-1].p[j+1].x, 
 	     WHIRL_TOP+whirl_state.whirl[WHIRLS-1].p[j+1].y);
 #if WHIRL_POINTS > 2
-  glcdLine(glcdChangeDot, 
+  glcdLine(GLCD_MODE_XOR, 
 	   whirl_state.whirl[WHIRLS-1].p[WHIRL_POINTS-1].x, 
 	   WHIRL_TOP+whirl_state.whirl[WHIRLS-1].p[WHIRL_POINTS-1].y, 
 	   whirl_state.whirl[WHIRLS-1].p[0].x, 
@@ -499,11 +1080,11 @@ int	main(void) {
   TCCR1B |= _BV(CS10);   
   OCR1AL = 32;
 
+  fifo.data = FIFO_NONE;
   usbInit();
 
   uart_init();
   DEBUGF("\n\n*** GLCD2USB ***\n");
-  DEBUGF("Driver: KS0108 %ux%u\n", GLCD_XPIXELS, GLCD_YPIXELS);
   DEBUGF("Version: %d.%02x\n", VERSION_MAJOR, VERSION_MINOR);
 
   /* make sure eeprom is valid */
@@ -520,6 +1101,18 @@ int	main(void) {
   } else 
     DEBUGF("EEPROM is valid\n");
 
+  /* panel geometry, eeproms written by older firmware don't have it */
+  {
+    uchar n = eeprom_read_byte(&config.controllers);
+    uchar cs[GLCD_MAX_CONTROLLERS];
+
+    if(n && n <= GLCD_MAX_CONTROLLERS) {
+      eeprom_read_block(cs, config.cs, n);
+      glcdSetGeometry(n, cs);
+    }
+  }
+  DEBUGF("Driver: KS0108 %ux%u\n", GLCD_XPIXELS, GLCD_YPIXELS);
+
   glcdInit();
   // send rprintf output to lcd display
   rprintfInit(glcdWriteChar);
@@ -532,9 +1125,27 @@ int	main(void) {
   sei();
   for(;;) {	/* main event loop */
     whirl_progress();
+
+    /* the crcs cover everything received before their request, the */
+    /* next frame stays in the fifo until the committed one is shown */
+    if(crc_state.state == CRC_RUNNING)
+      crc_process();
+    else if(!frame.commit)
+      fifo_process();
+
+    if(!frame.hold) {
+      glcdFlush();
+      frame.commit = 0;
+    }
+#ifdef GLCD_SHADOW
+    else if(frame.commit)
+      frame.commit = glcdFlushPart(FIFO_DRAIN);
+#endif
+
     wdt_reset();
     usbPoll();
     keyPressed();
+    keySendEvent();
 
     /* vectors is only != NULL if a bootloader is in use */
     if(__vectors) {
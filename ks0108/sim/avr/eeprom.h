@@ -0,0 +1,17 @@
+/*
+ * avr/eeprom.h - eeprom of the host simulation (see sim.c)
+ */
+
+#ifndef SIM_AVR_EEPROM_H
+#define SIM_AVR_EEPROM_H
+
+#include <stdint.h>
+
+#define EEMEM
+
+uint8_t eeprom_read_byte(const uint8_t *addr);
+uint16_t eeprom_read_word(const uint16_t *addr);
+void eeprom_read_block(void *dst, const void *src, unsigned int n);
+void eeprom_write_byte(uint8_t *addr, uint8_t value);
+
+#endif
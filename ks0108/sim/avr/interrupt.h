@@ -0,0 +1,11 @@
+/*
+ * avr/interrupt.h - the simulation has no interrupts
+ */
+
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+#define sei()
+#define cli()
+
+#endif
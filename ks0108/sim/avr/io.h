@@ -0,0 +1,76 @@
+/*
+ * avr/io.h - i/o registers for the host simulation of the firmware
+ *
+ * Every register access goes through sim_reg() so the simulator can
+ * track the display bus and account for the time spent (see sim.c).
+ */
+
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+#include <stdint.h>
+
+enum {
+  SIM_PORTA, SIM_DDRA, SIM_PINA,
+  SIM_PORTB, SIM_DDRB, SIM_PINB,
+  SIM_PORTC, SIM_DDRC, SIM_PINC,
+  SIM_PORTD, SIM_DDRD, SIM_PIND,
+  SIM_TCCR0, SIM_TCCR1A, SIM_TCCR1B, SIM_OCR1AL,
+  SIM_UCSRA, SIM_UCSRB, SIM_UCSRC, SIM_UBRRL, SIM_UBRRH, SIM_UDR,
+  SIM_REGS
+};
+
+extern volatile uint8_t sim_regs[SIM_REGS];
+volatile uint8_t *sim_reg(int reg);
+void sim_nop(void);
+void sim_delay(unsigned long cycles);
+
+#define SIM_REG(r)  (*sim_reg(SIM_##r))
+
+#define PORTA   SIM_REG(PORTA)
+#define DDRA    SIM_REG(DDRA)
+#define PINA    SIM_REG(PINA)
+#define PORTB   SIM_REG(PORTB)
+#define DDRB    SIM_REG(DDRB)
+#define PINB    SIM_REG(PINB)
+#define PORTC   SIM_REG(PORTC)
+#define DDRC    SIM_REG(DDRC)
+#define PINC    SIM_REG(PINC)
+#define PORTD   SIM_REG(PORTD)
+#define DDRD    SIM_REG(DDRD)
+#define PIND    SIM_REG(PIND)
+#define TCCR0   SIM_REG(TCCR0)
+#define TCCR1A  SIM_REG(TCCR1A)
+#define TCCR1B  SIM_REG(TCCR1B)
+#define OCR1AL  SIM_REG(OCR1AL)
+#define UCSRA   SIM_REG(UCSRA)
+#define UCSRB   SIM_REG(UCSRB)
+#define UCSRC   SIM_REG(UCSRC)
+#define UBRRL   SIM_REG(UBRRL)
+#define UBRRH   SIM_REG(UBRRH)
+#define UDR     SIM_REG(UDR)
+
+#define PA0 0
+#define PA1 1
+#define PA2 2
+#define PA3 3
+#define PA4 4
+#define PA5 5
+#define PA6 6
+#define PA7 7
+
+#define COM1A1  7
+#define WGM10   0
+#define WGM12   3
+#define CS10    0
+#define U2X     1
+#define UDRE    5
+#define TXEN    3
+#define URSEL   7
+#define UCSZ0   1
+
+#define _BV(b)  (1 << (b))
+#define bit_is_set(reg, b)          ((reg) & _BV(b))
+#define loop_until_bit_is_set(reg, b)  do { } while(!bit_is_set(reg, b))
+
+#endif
@@ -0,0 +1,19 @@
+/*
+ * avr/pgmspace.h - flash is ordinary memory in the simulation
+ */
+
+#ifndef SIM_AVR_PGMSPACE_H
+#define SIM_AVR_PGMSPACE_H
+
+#include <string.h>
+
+#define PROGMEM
+/* some sources use the attribute itself: __attribute__ ((progmem)) */
+#define progmem
+#define PSTR(s)             (s)
+#define pgm_read_byte(p)    (*(const unsigned char *)(p))
+#define pgm_read_word(p)    (*(const unsigned short *)(p))
+#define memcpy_P            memcpy
+#define printf_P            printf
+
+#endif
@@ -0,0 +1,12 @@
+/*
+ * avr/wdt.h - the simulation has no watchdog
+ */
+
+#ifndef SIM_AVR_WDT_H
+#define SIM_AVR_WDT_H
+
+#define WDTO_1S         6
+#define wdt_enable(t)
+#define wdt_reset()
+
+#endif
@@ -0,0 +1,553 @@
+/*
+ * sim.c - host simulation of the GLCD2USB firmware
+ *
+ * The firmware sources are compiled for the host using the avr headers
+ * from this directory. Every i/o register access ends up in sim_reg()
+ * which advances a simulated cpu clock and drives a model of the
+ * KS0108 controllers. Reports are read from a capture file and fed to
+ * usbFunctionSetup()/usbFunctionWrite() from within usbPoll(), one usb
+ * packet per call, so the real firmware main loop runs between them.
+ *
+ * Capture format: one SET_REPORT per line, hex bytes starting with the
+ * report id. A line with '<' and a report id requests that feature report
+ * (GET_REPORT), the reply is printed. A line with '=' followed by the
+ * columns x0 and x1, a page and a byte checks that the controllers'
+ * memory holds that byte in columns x0 to x1 of the page once all
+ * previous reports have been executed. The simulation exits with 1 if
+ * a check fails. Empty lines and lines starting with '#' are ignored.
+ *
+ * The timing is approximate: each register access and each NOP counts
+ * one cpu cycle, other cpu work is not accounted for. The numbers are
+ * meant to compare firmware versions with each other, not to predict
+ * the exact speed of the real hardware.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "usbdrv.h"
+#include "ks0108conf.h"
+#include "../../lcd4linux/glcd2usb.h"
+
+/* access registers without side effects from within the simulation */
+#undef SIM_REG
+#define SIM_REG(r)  sim_regs[SIM_##r]
+
+/* the panel has as many controllers as the firmware uses by default */
+#define CTRL_PAGES  (GLCD_YPIXELS/8)
+#define CTRL_COLS   64
+#define CTRL_NUM    GLCD_CONTROLLERS
+#define XPIXELS     (CTRL_NUM*CTRL_COLS)
+
+#define CYCLES_PER_US  (F_CPU/1000000)
+
+/* minimal width of the E pulse in ns according to the data sheet */
+#define E_HIGH_NS  450
+
+typedef struct {
+  unsigned char ram[CTRL_PAGES][CTRL_COLS];
+  unsigned char page, col, start, on;
+  unsigned char latch;         /* output register for data reads */
+  unsigned long busy_until;    /* cpu cycle the controller is ready again */
+} ctrl_t;
+
+typedef struct {
+  unsigned long cycles, commands, writes, reads, status, violations;
+} stats_t;
+
+volatile uint8_t sim_regs[SIM_REGS];
+unsigned long sim_cycles;
+
+static ctrl_t ctrl[CTRL_NUM];
+static stats_t total, report_start;
+static unsigned long busy_cycles = 1500 * CYCLES_PER_US / 1000;
+static unsigned long e_rise, last_access;
+static unsigned char ctrl_last;
+
+static FILE *capture;
+static char *image_name = NULL;
+static int verbose = 1, loops = 0, reports = 0, serialize = 0, failed = 0;
+static unsigned long naks = 0;
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- KS0108 model ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static const unsigned char ctrl_cs[] = GLCD_CS_TABLE;
+
+static int ctrl_selected(unsigned char port, int c) {
+  return (port & GLCD_CS_MASK) == ctrl_cs[c];
+}
+
+static void ctrl_check_busy(int c) {
+  if(last_access < ctrl[c].busy_until) {
+    if(verbose > 1)
+      fprintf(stderr, "controller %d accessed while busy\n", c);
+    total.violations++;
+  }
+}
+
+static void ctrl_command(int c, unsigned char cmd) {
+  total.commands++;
+
+  if((cmd & 0xfe) == 0x3e)       ctrl[c].on = cmd & 1;
+  else if((cmd & 0xc0) == 0x40)  ctrl[c].col = cmd & 0x3f;
+  else if((cmd & 0xf8) == 0xb8)  ctrl[c].page = cmd & 0x07;
+  else if((cmd & 0xc0) == 0xc0)  ctrl[c].start = cmd & 0x3f;
+  else
+    fprintf(stderr, "controller %d: unknown command 0x%02x\n", c, cmd);
+}
+
+/* called on every register access, reacts on the E edges caused */
+/* by the previous access which happened at cpu cycle last_access */
+static void ctrl_bus(void) {
+  unsigned char port = GLCD_CTRL_PORT;
+  int c;
+
+  /* controllers are held in reset */
+  if(!(port & _BV(GLCD_CTRL_RESET))) {
+    for(c=0;c<CTRL_NUM;c++) {
+      ctrl[c].on = 0;
+      ctrl[c].start = 0;
+    }
+  }
+
+  if(!((port ^ ctrl_last) & _BV(GLCD_CTRL_E))) {
+    ctrl_last = port;
+    return;
+  }
+
+  if(port & _BV(GLCD_CTRL_E)) {
+    /* rising edge: reads put their data onto the bus */
+    e_rise = last_access;
+
+    if(port & _BV(GLCD_CTRL_RW)) {
+      for(c=0;c<CTRL_NUM;c++) {
+	if(!ctrl_selected(port, c))
+	  continue;
+
+	if(port & _BV(GLCD_CTRL_RS)) {
+	  ctrl_check_busy(c);
+	  total.reads++;
+	  /* the output register is loaded from ram on each read, */
+	  /* thus a read returns the data addressed by the previous one */
+	  GLCD_DATA_PIN = ctrl[c].latch;
+	  ctrl[c].latch = ctrl[c].ram[ctrl[c].page][ctrl[c].col];
+	  ctrl[c].col = (ctrl[c].col + 1) % CTRL_COLS;
+	} else
+	  total.status++;
+      }
+    }
+  } else {
+    /* falling edge: writes are latched, signals as during the E pulse */
+    if((last_access - e_rise) * 1000 < E_HIGH_NS * CYCLES_PER_US) {
+      if(verbose > 1)
+	fprintf(stderr, "E pulse too short\n");
+      total.violations++;
+    }
+
+    if(!(ctrl_last & _BV(GLCD_CTRL_RW))) {
+      for(c=0;c<CTRL_NUM;c++) {
+	if(!ctrl_selected(ctrl_last, c))
+	  continue;
+
+	ctrl_check_busy(c);
+
+	if(ctrl_last & _BV(GLCD_CTRL_RS)) {
+	  total.writes++;
+	  ctrl[c].ram[ctrl[c].page][ctrl[c].col] = GLCD_DATA_PORT;
+	  ctrl[c].col = (ctrl[c].col + 1) % CTRL_COLS;
+	} else
+	  ctrl_command(c, GLCD_DATA_PORT);
+
+	ctrl[c].busy_until = last_access + busy_cycles;
+      }
+    }
+  }
+
+  ctrl_last = port;
+}
+
+/* value seen on the data bus while the controllers drive it */
+static unsigned char ctrl_status(void) {
+  unsigned char port = GLCD_CTRL_PORT;
+  int c;
+
+  for(c=0;c<CTRL_NUM;c++)
+    if(ctrl_selected(port, c))
+      return ((sim_cycles < ctrl[c].busy_until)?0x80:0) |
+	(ctrl[c].on?0:0x20) |
+	((port & _BV(GLCD_CTRL_RESET))?0:0x10);
+
+  return 0xff;
+}
+
+volatile uint8_t *sim_reg(int reg) {
+  unsigned char port;
+
+  sim_cycles++;
+  ctrl_bus();
+  last_access = sim_cycles;
+
+  port = GLCD_CTRL_PORT;
+  if(&sim_regs[reg] == &GLCD_DATA_PIN) {
+    /* data reads were latched on the rising edge of E */
+    if(!(port & _BV(GLCD_CTRL_E)) || !(port & _BV(GLCD_CTRL_RW)))
+      GLCD_DATA_PIN = GLCD_DATA_PORT;
+    else if(!(port & _BV(GLCD_CTRL_RS)))
+      GLCD_DATA_PIN = ctrl_status();
+  }
+
+  /* no buttons pressed */
+  if(reg == SIM_PINB)
+    PINB = 0xff;
+
+  return &sim_regs[reg];
+}
+
+void sim_nop(void) {
+  sim_cycles++;
+}
+
+void sim_delay(unsigned long cycles) {
+  sim_cycles += cycles;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- eeprom ---------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* eeprom variables live in (read only) ram on the host, so written */
+/* bytes are kept in a small table instead */
+#define EEPROM_SIZE  64
+
+static struct {
+  const uint8_t *addr;
+  uint8_t value;
+} eeprom[EEPROM_SIZE];
+static int eeprom_used;
+
+uint8_t eeprom_read_byte(const uint8_t *addr) {
+  int i;
+
+  for(i=0;i<eeprom_used;i++)
+    if(eeprom[i].addr == addr)
+      return eeprom[i].value;
+
+  return 0xff;    /* erased */
+}
+
+uint16_t eeprom_read_word(const uint16_t *addr) {
+  return eeprom_read_byte((const uint8_t*)addr) |
+    (eeprom_read_byte((const uint8_t*)addr + 1) << 8);
+}
+
+void eeprom_read_block(void *dst, const void *src, unsigned int n) {
+  unsigned int i;
+
+  for(i=0;i<n;i++)
+    ((uint8_t*)dst)[i] = eeprom_read_byte((const uint8_t*)src + i);
+}
+
+void eeprom_write_byte(uint8_t *addr, uint8_t value) {
+  int i;
+
+  for(i=0;i<eeprom_used && eeprom[i].addr != addr;i++);
+
+  if(i == EEPROM_SIZE) {
+    fprintf(stderr, "simulated eeprom is full\n");
+    exit(1);
+  }
+
+  eeprom[i].addr = addr;
+  eeprom[i].value = value;
+  if(i == eeprom_used) eeprom_used++;
+}
+
+/* ------------------------------------------------------------------------- */
+/* -------------------------------- usb ------------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+usbMsgPtr_t usbMsgPtr;
+usbTxStatus_t usbTxStatus1;
+volatile schar usbRxLen;
+
+/* firmware still has work queued for the display */
+extern uchar fifo_busy(void);
+void *__vectors = NULL;
+
+void usbInit(void) {
+  usbTxLen1 = USBPID_NAK;
+}
+
+void usbSetInterrupt(uchar *data, uchar len) {
+  /* the host picks it up immediately */
+}
+
+static void sim_write_image(void) {
+  FILE *f;
+  int x, y, c, line;
+  unsigned char byte = 0;
+
+  if(!(f = fopen(image_name, "wb"))) {
+    perror(image_name);
+    return;
+  }
+
+  /* pbm bitmap with the display contents as visible */
+  fprintf(f, "P4\n%d %d\n", XPIXELS, GLCD_YPIXELS);
+  for(y=0;y<GLCD_YPIXELS;y++) {
+    for(x=0;x<XPIXELS;x++) {
+      c = x / CTRL_COLS;
+      line = (y + ctrl[c].start) % GLCD_YPIXELS;
+
+      byte <<= 1;
+      if(ctrl[c].on && (ctrl[c].ram[line/8][x%CTRL_COLS] & _BV(line%8)))
+	byte |= 1;
+
+      if((x & 7) == 7)
+	fputc(byte, f);
+    }
+  }
+
+  fclose(f);
+}
+
+static void sim_print(const char *what, const stats_t *s) {
+  printf("%s%9lu cycles %8lu us %6lu cmd %6lu write %6lu read %6lu status\n",
+	 what, s->cycles, s->cycles / CYCLES_PER_US,
+	 s->commands, s->writes, s->reads, s->status);
+}
+
+static void sim_diff(stats_t *d, const stats_t *a, const stats_t *b) {
+  d->cycles = a->cycles - b->cycles;
+  d->commands = a->commands - b->commands;
+  d->writes = a->writes - b->writes;
+  d->reads = a->reads - b->reads;
+  d->status = a->status - b->status;
+}
+
+static void sim_finish(void) {
+  stats_t diff;
+
+  ctrl_bus();
+  total.cycles = sim_cycles;
+
+  if(loops) {
+    sim_diff(&diff, &total, &report_start);
+    diff.cycles /= loops;
+    diff.commands /= loops; diff.writes /= loops;
+    diff.reads /= loops; diff.status /= loops;
+    sim_print("per loop:  ", &diff);
+  } else {
+    printf("%d reports\n", reports);
+    sim_print("total:     ", &total);
+  }
+
+  if(naks)
+    printf("%lu polls while the firmware refused usb data\n", naks);
+
+  if(total.violations)
+    printf("%lu timing violations\n", total.violations);
+
+  if(image_name)
+    sim_write_image();
+
+  exit(failed);
+}
+
+/* compare the display memory with a check line from the capture */
+static void sim_check(const unsigned char *buffer, int len) {
+  int x;
+
+  if(len != 4 || buffer[1] >= XPIXELS || buffer[2] >= CTRL_PAGES) {
+    fprintf(stderr, "check after report %d: invalid\n", reports);
+    failed = 1;
+    return;
+  }
+
+  for(x=buffer[0];x<=buffer[1];x++) {
+    if(ctrl[x/CTRL_COLS].ram[buffer[2]][x%CTRL_COLS] != buffer[3]) {
+      fprintf(stderr, "check after report %d: column %d page %d is %02x, expected %02x\n",
+	      reports, x, buffer[2], ctrl[x/CTRL_COLS].ram[buffer[2]][x%CTRL_COLS], buffer[3]);
+      failed = 1;
+      return;
+    }
+  }
+}
+
+/* read the next report from the capture file. get is 1 for a */
+/* report requested from the firmware and 2 for a check */
+static int sim_read_report(unsigned char *buffer, int max, int *get) {
+  char line[1024], *p, *end;
+  int len;
+
+  while(fgets(line, sizeof(line), capture)) {
+    if(line[0] == '#')
+      continue;
+
+    *get = (line[0] == '<') ? 1 : (line[0] == '=') ? 2 : 0;
+    for(len=0, p=line+(*get != 0); len < max; len++, p=end) {
+      buffer[len] = strtoul(p, &end, 16);
+      if(end == p) break;
+    }
+
+    if(len)
+      return len;
+  }
+
+  return 0;
+}
+
+/* one usb packet is handled per usbPoll() call like on the real device */
+void usbPoll(void) {
+  static int started = 0, checking = 0;
+  static unsigned char buffer[256];
+  static int len, pos;
+  usbRequest_t rq;
+  stats_t diff;
+  int get, i, n;
+
+  /* benchmark the main loop without any usb traffic */
+  if(loops) {
+    /* skip the first iteration which contains the init */
+    if(!started++) {
+      total.cycles = sim_cycles;
+      report_start = total;
+    }
+
+    if(started > loops)
+      sim_finish();
+
+    return;
+  }
+
+  /* the firmware lets the host wait (NAK) */
+  if(usbAllRequestsAreDisabled()) {
+    naks++;
+    return;
+  }
+
+  /* data packets of the current report */
+  if(started && pos < len) {
+    usbFunctionWrite(buffer+pos, (len-pos > 8)?8:(len-pos));
+    pos += 8;
+    return;
+  }
+
+  /* the host would only see the firmware being busy with the previous */
+  /* report as a delayed response to the next one */
+  if(started && serialize && fifo_busy())
+    return;
+
+  total.cycles = sim_cycles;
+
+  /* a check waits for the firmware to finish all queued commands */
+  if(checking) {
+    if(fifo_busy())
+      return;
+    sim_check(buffer, len);
+    checking = 0;
+  }
+
+  /* the previous report has been received, the firmware may still */
+  /* be busy with it while the next one arrives */
+  else if(started && verbose) {
+    sim_diff(&diff, &total, &report_start);
+    printf("%5d id %2d len %3d: ", reports, buffer[0], len);
+    sim_print("", &diff);
+  }
+  started = 1;
+
+  if(!(len = sim_read_report(buffer, sizeof(buffer), &get))) {
+    /* wait for the firmware to finish all queued commands */
+    if(!fifo_busy())
+      sim_finish();
+    return;
+  }
+
+  if(get == 2) {
+    checking = 1;
+    pos = len;
+    return;
+  }
+
+  reports++;
+  report_start = total;
+
+  /* HID SET_REPORT feature request. the structure is used since its */
+  /* layout on the host differs from the 8 bytes on the wire */
+  memset(&rq, 0, sizeof(rq));
+  rq.bmRequestType = USBRQ_TYPE_CLASS | USBRQ_RCPT_INTERFACE;
+  rq.bRequest = USBRQ_HID_SET_REPORT;
+  rq.wValue.bytes[0] = buffer[0];
+  rq.wValue.bytes[1] = 3;          /* feature report */
+  rq.wLength.word = len;
+
+  /* the reply is sent from the buffer usbFunctionSetup() points to */
+  if(get) {
+    rq.bmRequestType |= USBRQ_DIR_DEVICE_TO_HOST;
+    rq.bRequest = USBRQ_HID_GET_REPORT;
+    rq.wLength.word = 255;
+
+    n = usbFunctionSetup((uchar*)&rq);
+    printf("report %d get %d:", reports, buffer[0]);
+    for(i = 0; i < n; i++)
+      printf(" %02x", usbMsgPtr[i]);
+    printf("\n");
+
+    pos = len;
+    return;
+  }
+
+  pos = 0;
+  if(usbFunctionSetup((uchar*)&rq) != 0xff) {
+    fprintf(stderr, "report %d not accepted\n", reports);
+    pos = len;
+  }
+}
+
+/* ------------------------------------------------------------------------- */
+
+extern int firmware_main(void);
+
+static void usage(char *name) {
+  printf("Usage: %s [options] [capture file]\n"
+	 "  -b ns      busy time of the controller after an access (1500)\n"
+	 "  -o file    write final display contents to pbm image\n"
+	 "  -l loops   measure main loop iterations (e.g. whirl animation)\n"
+	 "  -q         don't print per report statistics\n"
+	 "  -w         wait until a report has been executed before sending the\n"
+	 "             next one, the statistics then cover exactly one report\n"
+	 "  -v         report timing violations in detail\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  int opt;
+
+  while((opt = getopt(argc, argv, "b:o:l:qwvh")) != -1) {
+    switch(opt) {
+    case 'b': busy_cycles = atol(optarg) * CYCLES_PER_US / 1000; break;
+    case 'o': image_name = optarg; break;
+    case 'l': loops = atoi(optarg); break;
+    case 'q': verbose = 0; break;
+    case 'w': serialize = 1; break;
+    case 'v': verbose = 2; break;
+    default: usage(argv[0]);
+    }
+  }
+
+  capture = stdin;
+  if(optind < argc && !(capture = fopen(argv[optind], "r"))) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  return firmware_main();
+}
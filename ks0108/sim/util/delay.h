@@ -0,0 +1,13 @@
+/*
+ * util/delay.h - delays only advance the simulated clock
+ */
+
+#ifndef SIM_UTIL_DELAY_H
+#define SIM_UTIL_DELAY_H
+
+#include <avr/io.h>
+
+#define _delay_loop_1(n)    sim_delay(3ul * (n))
+#define _delay_loop_2(n)    sim_delay(4ul * (n))
+
+#endif
@@ -78,6 +78,12 @@ must be adapted to your hardware.
  * data from a static buffer, set it to 0 and return the data from
  * usbFunctionSetup(). This saves a couple of bytes.
  */
+#define USB_CFG_HAVE_FLOWCONTROL		1
+/* Define this to 1 if you want flowcontrol over USB data. See the definition
+ * of the macros usbDisableAllRequests() and usbEnableAllRequests() in
+ * usbdrv.h. The firmware uses it to stop the host while its command fifo
+ * is full.
+ */
 
 /* -------------------------- Device Description --------------------------- */
 
@@ -115,6 +121,6 @@ must be adapted to your hardware.
  * protocol.
  */
 
-#define USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH    (105)  /* total length of report descriptor */
+#define USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH    (195)  /* total length of report descriptor */
 
 #endif /* __usbconfig_h_included__ */
@@ -35,11 +35,36 @@
 
 /*
  * Options:
+ *   TransferCost  estimated USB overhead of one write report in us (1000)
+ *   ByteCost      estimated USB wire time of one report byte in us (8)
+ *   MaxFPS        max. number of display updates per second, 0 = unlimited (0)
+ *   FirmwareFont  send text as characters drawn with the display's own 5x7
+ *                 font where the 6x8 host font has the same glyphs (0)
+ *   Device1..8    serial number or bus path (e.g. '001/004' as listed by
+ *                 lsusb) of the displays to use. Without any, the first
+ *                 display found is used. A display that gets lost (e.g.
+ *                 unplugged) is reopened as soon as it's back. One selected
+ *                 by its bus path has to come back at the same path
+ *   Verify        interval in s to compare crcs of the display memory with
+ *                 the offscreen buffer and send the parts again that
+ *                 differ (e.g. after esd glitches), 0 = never (0)
+ *   Tiles         columns x rows of equally sized displays making up one
+ *                 large display, Device1, Device2, ... are placed row by
+ *                 row. With 1x1 all displays show the same contents
+ *                 (1x1)
+ *   ShadowDir     directory to save the display contents in when the
+ *                 driver stops (e.g. '/run/lcd4linux'). Displays
+ *                 supporting it keep showing them instead of the screen
+ *                 saver, and after a restart only what changed is sent.
+ *                 Without crc support a display must not be replugged
+ *                 meanwhile. Empty = clear the displays on every start
+ *                 ('')
  */
 
 #include "config.h"
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
@@ -47,6 +72,8 @@
 #include <termios.h>
 #include <fcntl.h>
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <pthread.h>
 #include <usb.h>
 
 #include "debug.h"
@@ -80,14 +107,13 @@
 /* ------------------------------------------------------------------------ */
 
 #include "glcd2usb.h"
+#include "glcd2usb_font.h"
 
 /* ------------------------------------------------------------------------- */
 
 #define USBRQ_HID_GET_REPORT    0x01
 #define USBRQ_HID_SET_REPORT    0x09
 
-usb_dev_handle *dev = NULL;
-
 /* USB message buffer */
 static union {
     unsigned char bytes[132];
@@ -149,7 +175,28 @@ static int usbGetString(usb_dev_handle * dev, int index, char *buf, int buflen)
 
 /* ------------------------------------------------------------------------- */
 
-int usbOpenDevice(usb_dev_handle ** device, int vendor, char *vendorName, int product, char *productName)
+static int drv_GLCD2USB_in_use(struct usb_device *dev);
+
+/* is this the device selected by its serial number or its bus path */
+/* (bus and device number as listed by lsusb, e.g. 001/004)? */
+static int usbSelected(usb_dev_handle * handle, struct usb_device *dev, const char *select)
+{
+    char string[256];
+    int len = strlen(dev->bus->dirname);
+
+    if (select == NULL)
+	return 1;
+
+    if (strchr(select, '/'))
+	return strncmp(select, dev->bus->dirname, len) == 0 && select[len] == '/' &&
+	    strcmp(select + len + 1, dev->filename) == 0;
+
+    return dev->descriptor.iSerialNumber &&
+	usbGetString(handle, dev->descriptor.iSerialNumber, string, sizeof(string)) >= 0 && strcmp(string, select) == 0;
+}
+
+int usbOpenDevice(usb_dev_handle ** device, int vendor, char *vendorName, int product, char *productName,
+		  const char *select)
 {
     struct usb_bus *bus;
     struct usb_device *dev;
@@ -167,7 +214,7 @@ int usbOpenDevice(usb_dev_handle ** device, int vendor, char *vendorName, int pr
 
     for (bus = usb_get_busses(); bus; bus = bus->next) {
 	for (dev = bus->devices; dev; dev = dev->next) {
-	    if (dev->descriptor.idVendor == vendor && dev->descriptor.idProduct == product) {
+	    if (dev->descriptor.idVendor == vendor && dev->descriptor.idProduct == product && !drv_GLCD2USB_in_use(dev)) {
 		char string[256];
 		int len;
 		handle = usb_open(dev);	/* we need to open the device in order to query strings */
@@ -176,6 +223,11 @@ int usbOpenDevice(usb_dev_handle ** device, int vendor, char *vendorName, int pr
 		    error("%s Warning: cannot open USB device: %s", Name, usb_strerror());
 		    continue;
 		}
+		if (!usbSelected(handle, dev, select)) {
+		    usb_close(handle);
+		    handle = NULL;
+		    continue;
+		}
 		if (vendorName == NULL && productName == NULL) {	/* name does not matter */
 		    break;
 		}
@@ -262,6 +314,34 @@ int usbSetReport(usb_dev_handle * device, int reportType, unsigned char *buffer,
 	buffer[0] = GLCD2USB_RID_WRITE + i;
     }
 
+    /* same for the rle write command */
+    if (buffer[0] == GLCD2USB_RID_WRITE_RLE) {
+	if (len > 64 + 4)
+	    error("%s: %d bytes usb report is too long \n", Name, len);
+
+	buffer[0] = GLCD2USB_RID_WRITE_RLE + ((len > 16 + 4) ? 1 : 0);
+	len = (len > 16 + 4) ? 64 + 4 : 16 + 4;
+    }
+
+    /* the text command has the same format, but only one size */
+    if (buffer[0] == GLCD2USB_RID_TEXT) {
+	if (len > 64 + 4)
+	    error("%s: %d bytes usb report is too long \n", Name, len);
+
+	memset(buffer + len, 0, 64 + 4 - len);
+	len = 64 + 4;
+    }
+
+    /* and the multi write command. its padding ends the segment list */
+    if (buffer[0] == GLCD2USB_RID_WRITE_MULTI) {
+	if (len > 128 + 4)
+	    error("%s: %d bytes usb report is too long \n", Name, len);
+
+	buffer[0] = GLCD2USB_RID_WRITE_MULTI + ((len > 64 + 4) ? 1 : 0);
+	memset(buffer + len, 0, ((len > 64 + 4) ? 128 + 4 : 64 + 4) - len);
+	len = (len > 64 + 4) ? 128 + 4 : 64 + 4;
+    }
+
     bytesSent = usb_control_msg(device, USB_TYPE_CLASS | USB_RECIP_INTERFACE |
 				USB_ENDPOINT_OUT, USBRQ_HID_SET_REPORT,
 				reportType << 8 | buffer[0], 0, (char *) buffer, len, 1000);
@@ -307,335 +387,1939 @@ char *usbErrorMessage(int errCode)
     return NULL;		/* not reached */
 }
 
-static char *video_buffer = NULL;
-static char *dirty_buffer = NULL;
+/* dirty_buffer values besides 0 and 1: the first and the following */
+/* bytes of a character cell that may be sent as text */
+#define DIRTY_TEXT       2
+#define DIRTY_TEXT_CELL  3
 
-static void drv_GLCD2USB_blit(const int row, const int col, const int height, const int width)
-{
-    int r, c, err, i, j;
+/* cost model, see drv_GLCD2USB_plan_init() */
+static int cost_transfer, cost_byte;
 
-    /* update offscreen buffer */
-    for (r = row; r < row + height; r++) {
-	for (c = col; c < col + width; c++) {
-	    int x, y, bit;
+/* update rate limit */
+static int frame_interval = 0;	/* ms, 0 = no limit */
+static int flush_pending = 0;
+static struct timeval last_flush;
 
-	    /* these assignments are display layout dependent */
-	    x = c;
-	    y = r / 8;
-	    bit = r % 8;
+/* display memory check, see drv_GLCD2USB_crc_request() */
+static int verify_interval = 0;	/* ms, 0 = never */
 
-	    i = video_buffer[x + DCOLS * y];
+/* saved display contents, see drv_GLCD2USB_shadow_save() */
+static char *shadow_dir = NULL;	/* NULL = don't keep them */
 
-	    if (drv_generic_graphic_black(r, c))
-		video_buffer[x + DCOLS * y] |= 1 << bit;
-	    else
-		video_buffer[x + DCOLS * y] &= ~(1 << bit);
+/* ------------------------------------------------------------------------- */
 
-	    if (video_buffer[x + DCOLS * y] != i)
-		dirty_buffer[x + DCOLS * y] |= 1 << bit;
-	}
-    }
+/* all reports to the display are sent by a separate i/o thread, so */
+/* lcd4linux never has to wait for the (slow) low speed usb link */
+#define QUEUE_SIZE  64
+
+/* firmware with FLAG_BUTTON_EVENTS sends button changes via the */
+/* interrupt endpoint which the i/o thread reads while it's idle */
+#define BUTTON_QUEUE_SIZE  16
+#define BUTTON_TIMEOUT     10	/* ms, interrupt read timeout */
+#define TIMER_INTERVAL     10	/* ms */
+#define POLL_INTERVAL     100	/* ms, button polling for old firmware */
+#define RETRY_INTERVAL   1000	/* ms, between attempts to reopen a lost display */
+
+typedef struct {
+    int len;			/* 0 if superseded by a later report */
+    int frame;			/* number of the flush that queued it */
+    unsigned char bytes[132];
+} report_t;
+
+/* several displays may be driven at once. each of them has its own */
+/* offscreen buffer and i/o thread, so a slow one doesn't hold up the */
+/* updates of the others */
+#define MAX_DEVICES  8
+
+typedef struct {
+    usb_dev_handle *dev;
+    char *select;		/* serial number or bus path, NULL = any */
+    int x, y;			/* position of the display's tile */
+    int width, height;
+
+    /* feature flags reported by the display */
+    unsigned char flags, flags2;
+
+    unsigned char *video_buffer;
+    unsigned char *dirty_buffer;
+    unsigned char *page_buffer;
+
+    /* area of the dirty_buffer that may contain dirty bytes */
+    int dirty_lo, dirty_hi;
+
+    /* a frame end couldn't be queued and has to be sent with the next flush */
+    int commit_pending;
+
+    /* text is sent as characters, see drv_GLCD2USB_flush_text() */
+    int text_enabled;
+
+    /* display start line, and the one the display has been told about */
+    int scroll, scroll_sent;
+    unsigned char *scroll_frame, *scroll_old, *scroll_new;
+    unsigned int *scroll_hash;
+
+    /* estimated wire time in microseconds of one write report of each */
+    /* payload length incl. the padding up to the next report size */
+    int plan_cost_table[128 + 1];
+    int plan_rle_cost[2];	/* same for the two rle report sizes */
+
+    /* for every offset: end of the run starting there (or -1 if the */
+    /* byte isn't part of any run) and the cost of the optimal plan */
+    /* for everything from there to the end of the dirty area */
+    int *plan_next;
+    int *plan_cost;
+
+    unsigned int last_but;	/* last button state seen */
+
+    struct timeval last_verify;	/* last crc request */
+
+    struct {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	report_t report[QUEUE_SIZE];
+	int head, count, quit, running;
+	int sending;		/* frame of the display data being sent, 0 = none */
+	int offline;		/* display lost, the i/o thread tries to reopen it */
+	int resync;		/* display reopened, its contents have to be sent again */
+	unsigned int mismatch;	/* pages whose crcs differ, to be sent again */
+	unsigned long superseded, dropped;	/* statistics in bytes */
+	unsigned char button[BUTTON_QUEUE_SIZE];	/* received button states */
+	int button_head, button_count, button_events, button_errors;
+    } queue;
+} device_t;
+
+static device_t device[MAX_DEVICES];
+static int devices = 0;
+
+/* several displays show a new frame together: each of them commits */
+/* it only after all others have received their data of the frame */
+static pthread_mutex_t frame_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t frame_cond = PTHREAD_COND_INITIALIZER;
+static int frames = 0;		/* flushes queued for all displays */
+
+/* the i/o threads reopen lost displays at any time. this protects the */
+/* search for displays and the handles of all displays while doing so */
+static pthread_mutex_t usb_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* last brightness set, restored after reopening a display */
+static int backlight = -1;
+
+/* is a display already used by the driver? (usb_mutex held) */
+static int drv_GLCD2USB_in_use(struct usb_device *dev)
+{
+    int i;
 
-#if 0
-    /* display what's in the buffer (for debugging) */
-    for (r = 0; r < DROWS; r++) {
-	for (c = 0; c < DCOLS; c++) {
-	    if (video_buffer[c + DCOLS * (r / 8)] & (1 << (r % 8)))
-		putchar('#');
-	    else
-		putchar(' ');
-	}
-	putchar('\n');
-    }
-#endif
+    for (i = 0; i < devices; i++)
+	if (device[i].dev != NULL && usb_device(device[i].dev) == dev)
+	    return 1;
 
-    /* short gaps of unchanged bytes in fact increase the communication */
-    /* overhead. so we eliminate them here */
-    for (j = -1, i = 0; i < DROWS * DCOLS / 8; i++) {
-	if (dirty_buffer[i] && j >= 0 && i - j <= 4) {
-	    /* found a clean gap <= 4 bytes: mark it dirty */
-	    for (r = j; r < i; r++)
-		dirty_buffer[r] = 1;
-	}
-
-	/* if this is dirty, drop the saved position */
-	if (dirty_buffer[i])
-	    j = -1;
-
-	/* save position of this clean entry if there's no position saved yet */
-	if (!dirty_buffer[i] && j < 0)
-	    j = i;
-    }
-
-    /* and do the actual data transmission */
-    buffer.bytes[0] = 0;
-    for (i = 0; i < DROWS * DCOLS / 8; i++) {
-	if (dirty_buffer[i]) {
-	    /* starting a new run? */
-	    if (!buffer.bytes[0]) {
-		buffer.bytes[0] = GLCD2USB_RID_WRITE;
-		buffer.bytes[1] = i % 256;	// offset
-		buffer.bytes[2] = i / 256;
-		buffer.bytes[3] = 0;	// length
-	    }
-	    buffer.bytes[4 + buffer.bytes[3]++] = video_buffer[i];
-	}
+    return 0;
+}
 
-	/* this part of the buffer is not dirty or we are at end */
-	/* of buffer or the buffer is fill: send data then */
-	if ((!dirty_buffer[i]) || (i == DROWS * DCOLS / 8 - 1) || (buffer.bytes[3] == 128)) {
-	    /* is there data to be sent in the buffer? */
-	    if (buffer.bytes[0] && buffer.bytes[3]) {
-		if ((err = usbSetReport(dev, USB_HID_REPORT_TYPE_FEATURE, buffer.bytes, buffer.bytes[3] + 4)) != 0)
-		    error("%s: Error sending display contents: %s", Name, usbErrorMessage(err));
+/* open the display selected for d */
+static int drv_GLCD2USB_find(device_t * d)
+{
+    int err;
 
-		buffer.bytes[0] = 0;
-	    }
-	}
+    pthread_mutex_lock(&usb_mutex);
+    if ((err = usbOpenDevice(&d->dev, IDENT_VENDOR_NUM, IDENT_VENDOR_STRING,
+			     IDENT_PRODUCT_NUM, IDENT_PRODUCT_STRING, d->select)) != 0)
+	err = usbOpenDevice(&d->dev, IDENT_VENDOR_NUM_OLD, IDENT_VENDOR_STRING,
+			    IDENT_PRODUCT_NUM_OLD, IDENT_PRODUCT_STRING, d->select);
+    if (err)
+	d->dev = NULL;
+    pthread_mutex_unlock(&usb_mutex);
 
-	/* this entry isn't dirty anymore */
-	dirty_buffer[i] = 0;
-    }
+    return err;
 }
 
-static int drv_GLCD2USB_brightness(int brightness)
+/* close the usb device of a display */
+static void drv_GLCD2USB_release(device_t * d)
 {
-    int err = 0;
-
-    printf("setting bright to %d\n", brightness);
+    pthread_mutex_lock(&usb_mutex);
+    usbCloseDevice(d->dev);
+    d->dev = NULL;
+    pthread_mutex_unlock(&usb_mutex);
+}
 
-    if (brightness < 0)
-	brightness = 0;
-    if (brightness > 255)
-	brightness = 255;
+/* allocate an opened display and make it show complete frames only. */
+/* unless its contents are kept the display is cleared */
+static int drv_GLCD2USB_allocate(device_t * d, const int keep)
+{
+    unsigned char bytes[2];
+    int err;
 
-    buffer.bytes[0] = GLCD2USB_RID_SET_BL;
-    buffer.bytes[1] = brightness;
-    if ((err = usbSetReport(dev, USB_HID_REPORT_TYPE_FEATURE, buffer.bytes, 2)) != 0) {
-	error("%s: Error freeing display: %s\n", Name, usbErrorMessage(err));
-	usbCloseDevice(dev);
+    /* get access to display */
+    bytes[0] = GLCD2USB_RID_SET_ALLOC;
+    bytes[1] = keep ? GLCD2USB_ALLOC_ON | GLCD2USB_ALLOC_KEEP : GLCD2USB_ALLOC_ON;
+    if ((err = usbSetReport(d->dev, USB_HID_REPORT_TYPE_FEATURE, bytes, 2)) != 0) {
+	error("%s: Error allocating display: %s", Name, usbErrorMessage(err));
 	return -1;
     }
 
-    return brightness;
+    /* only show complete frames from now on */
+    if (d->flags2 & FLAG2_COMMIT) {
+	bytes[0] = GLCD2USB_RID_COMMIT;
+	bytes[1] = 1;		/* 1=hold, 0=show writes immediately */
+	if ((err = usbSetReport(d->dev, USB_HID_REPORT_TYPE_FEATURE, bytes, 2)) != 0)
+	    error("%s: Error enabling frame commits: %s", Name, usbErrorMessage(err));
+    }
+
+    return 0;
 }
 
-static void drv_GLCD2USB_timer(void __attribute__ ((unused)) * notused)
+/* give up access to a display. if keep is set it goes on showing its */
+/* contents instead of starting the screen saver */
+static void drv_GLCD2USB_deallocate(device_t * d, const int keep)
 {
-    /* request button state */
-    static unsigned int last_but = 0;
-    int err = 0, len = 2;
-
-    if ((err = usbGetReport(dev, USB_HID_REPORT_TYPE_FEATURE, GLCD2USB_RID_GET_BUTTONS, buffer.bytes, &len)) != 0) {
-	fprintf(stderr, "Error getting button state: %s\n", usbErrorMessage(err));
-	return;
-    }
+    unsigned char bytes[2];
+    int err;
 
-    int i;
+    bytes[0] = GLCD2USB_RID_SET_ALLOC;
+    bytes[1] = keep ? GLCD2USB_ALLOC_KEEP : 0;	/* free */
+    if ((err = usbSetReport(d->dev, USB_HID_REPORT_TYPE_FEATURE, bytes, 2)) != 0)
+	error("%s Error freeing display: %s", Name, usbErrorMessage(err));
+}
 
-    /* check if button state changed */
-    if (buffer.bytes[1] ^ last_but) {
+/* keep a button state received from a display (queue mutex held) */
+static void drv_GLCD2USB_button_store(device_t * d, const unsigned char state)
+{
+    /* if the main thread doesn't keep up, the newest state replaces the last one */
+    if (d->queue.button_count == BUTTON_QUEUE_SIZE)
+	d->queue.button_count--;
+    d->queue.button[(d->queue.button_head + d->queue.button_count++) % BUTTON_QUEUE_SIZE] = state;
+}
 
-	/* send single keypad events for all changed buttons */
-	for (i = 0; i < 4; i++)
-	    if ((buffer.bytes[1] & (1 << i)) ^ (last_but & (1 << i)))
-		drv_generic_keypad_press(((buffer.bytes[1] & (1 << i)) ? 0x80 : 0) | i);
+/* wait a short moment for a button event on the interrupt endpoint */
+static void drv_GLCD2USB_button_read(device_t * d)
+{
+    char bytes[2];
+    int len;
+
+    len = usb_interrupt_read(d->dev, USB_ENDPOINT_IN | 1, bytes, sizeof(bytes), BUTTON_TIMEOUT);
+
+    pthread_mutex_lock(&d->queue.mutex);
+    if (len == sizeof(bytes) && bytes[0] == GLCD2USB_RID_GET_BUTTONS) {
+	drv_GLCD2USB_button_store(d, bytes[1]);
+	d->queue.button_errors = 0;
+    } else if (len < 0 && len != -ETIMEDOUT && ++d->queue.button_errors >= 3) {
+	error("%s: reading button events failed, polling buttons instead: %s", Name, usb_strerror());
+	d->queue.button_events = 0;
     }
-
-    last_but = buffer.bytes[1];
+    pthread_mutex_unlock(&d->queue.mutex);
 }
 
-static int drv_GLCD2USB_start(const char *section)
+/* request the button state from old firmware */
+static int drv_GLCD2USB_button_poll(device_t * d)
 {
-    int brightness;
-    char *s;
-    int err = 0, len;
+    unsigned char bytes[2];
+    int err, len = sizeof(bytes);
 
-    if (sscanf(s = cfg_get(section, "font", "6x8"), "%dx%d", &XRES, &YRES) != 2 || XRES < 1 || YRES < 1) {
-	error("%s: bad %s.Font '%s' from %s", Name, section, s, cfg_source());
-	free(s);
+    if ((err = usbGetReport(d->dev, USB_HID_REPORT_TYPE_FEATURE, GLCD2USB_RID_GET_BUTTONS, bytes, &len)) != 0) {
+	error("%s: Error getting button state: %s", Name, usbErrorMessage(err));
 	return -1;
     }
-    free(s);
 
-    if ((err = usbOpenDevice(&dev, IDENT_VENDOR_NUM, IDENT_VENDOR_STRING,
-			     IDENT_PRODUCT_NUM, IDENT_PRODUCT_STRING)) != 0) {
-	if ((err = usbOpenDevice(&dev, IDENT_VENDOR_NUM_OLD, IDENT_VENDOR_STRING,
-				 IDENT_PRODUCT_NUM_OLD, IDENT_PRODUCT_STRING)) != 0) {
-	    error("%s: opening GLCD2USB device: %s", Name, usbErrorMessage(err));
-	    return -1;
-	}
-    }
+    pthread_mutex_lock(&d->queue.mutex);
+    drv_GLCD2USB_button_store(d, bytes[1]);
+    pthread_mutex_unlock(&d->queue.mutex);
 
-    info("%s: Found device", Name);
+    return 0;
+}
 
-    /* query display parameters */
-    memset(&buffer, 0, sizeof(buffer));
+/* have all display data of the frames up to f been sent to display d? */
+static int drv_GLCD2USB_frame_sent(device_t * d, const int f)
+{
+    report_t *report;
+    int n, sent;
+
+    pthread_mutex_lock(&d->queue.mutex);
+    sent = d->queue.offline || !d->queue.sending || d->queue.sending > f;
+    for (n = 0; sent && n < d->queue.count; n++) {
+	report = &d->queue.report[(d->queue.head + n) % QUEUE_SIZE];
+	if (report->len && report->bytes[0] != GLCD2USB_RID_COMMIT && report->frame <= f)
+	    sent = 0;
+    }
+    pthread_mutex_unlock(&d->queue.mutex);
 
-    len = sizeof(display_info_t);
-    if ((err = usbGetReport(dev, USB_HID_REPORT_TYPE_FEATURE, GLCD2USB_RID_GET_INFO, buffer.bytes, &len)) != 0) {
+    return sent;
+}
 
-	error("%s: query display parameters: %s", Name, usbErrorMessage(err));
-	usbCloseDevice(dev);
-	return -1;
-    }
+/* wait until the other displays are ready to show frame f */
+static void drv_GLCD2USB_frame_wait(device_t * d, const int f)
+{
+    int i;
 
-    if (len < (int) sizeof(buffer.display_info)) {
-	error("%s: Not enough bytes in display info report (%d instead of %d)",
-	      Name, len, (int) sizeof(buffer.display_info));
-	usbCloseDevice(dev);
-	return -1;
+    pthread_mutex_lock(&frame_mutex);
+    for (i = 0; i < devices;) {
+	if (f > frames || (&device[i] != d && !drv_GLCD2USB_frame_sent(&device[i], f))) {
+	    pthread_cond_wait(&frame_cond, &frame_mutex);
+	    i = 0;
+	} else
+	    i++;
     }
+    pthread_mutex_unlock(&frame_mutex);
+}
 
-    info("%s: display name = %s", Name, buffer.display_info.name);
-    info("%s: display resolution = %d * %d", Name, buffer.display_info.width, buffer.display_info.height);
-    info("%s: display flags: %x", Name, buffer.display_info.flags);
+/* wake up the displays waiting for others in drv_GLCD2USB_frame_wait() */
+static void drv_GLCD2USB_frame_signal(void)
+{
+    pthread_mutex_lock(&frame_mutex);
+    pthread_cond_broadcast(&frame_cond);
+    pthread_mutex_unlock(&frame_mutex);
+}
 
-    /* TODO: check for supported features */
+/* the time ms milliseconds from now for pthread_cond_timedwait() */
+static void drv_GLCD2USB_deadline(struct timespec *ts, const int ms)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    ts->tv_sec = now.tv_sec + ms / 1000;
+    ts->tv_nsec = (now.tv_usec + (ms % 1000) * 1000) * 1000L;
+    if (ts->tv_nsec >= 1000000000L) {
+	ts->tv_sec++;
+	ts->tv_nsec -= 1000000000L;
+    }
+}
 
+/* has a time from drv_GLCD2USB_deadline() passed? */
+static int drv_GLCD2USB_passed(const struct timespec *ts)
+{
+    struct timeval now;
 
-    /* save display size */
-    DCOLS = buffer.display_info.width;
-    DROWS = buffer.display_info.height;
+    gettimeofday(&now, NULL);
+    return now.tv_sec > ts->tv_sec || (now.tv_sec == ts->tv_sec && now.tv_usec * 1000L >= ts->tv_nsec);
+}
 
-    /* allocate a offscreen buffer */
-    video_buffer = malloc(DCOLS * DROWS / 8);
-    dirty_buffer = malloc(DCOLS * DROWS / 8);
-    memset(video_buffer, 0, DCOLS * DROWS / 8);
-    memset(dirty_buffer, 0, DCOLS * DROWS / 8);
+/* compare the crcs of the display memory with those the offscreen */
+/* buffer had when they were requested. the main thread sends the */
+/* pages that differ again, see drv_GLCD2USB_crc_repair() */
+static int drv_GLCD2USB_crc_check(device_t * d, const report_t * report)
+{
+    unsigned char bytes[1 + 2 * GLCD2USB_CRC_PAGES];
+    unsigned int mismatch = 0;
+    int err, i, len = sizeof(bytes);
+
+    /* the display computes them while getting the report waits */
+    bytes[0] = GLCD2USB_RID_GET_CRC;
+    if ((err = usbSetReport(d->dev, USB_HID_REPORT_TYPE_FEATURE, bytes, 1)) != 0) {
+	error("%s: Error requesting display crcs: %s", Name, usbErrorMessage(err));
+	return err;
+    }
 
-    /* get access to display */
-    buffer.bytes[0] = GLCD2USB_RID_SET_ALLOC;
-    buffer.bytes[1] = 1;	/* 1=alloc, 0=free */
-    if ((err = usbSetReport(dev, USB_HID_REPORT_TYPE_FEATURE, buffer.bytes, 2)) != 0) {
-	error("%s: Error allocating display: %s", Name, usbErrorMessage(err));
-	usbCloseDevice(dev);
-	return -1;
+    if ((err = usbGetReport(d->dev, USB_HID_REPORT_TYPE_FEATURE, GLCD2USB_RID_GET_CRC, bytes, &len)) != 0) {
+	error("%s: Error getting display crcs: %s", Name, usbErrorMessage(err));
+	return err;
     }
 
-    /* regularly request key state. can be quite slow since the device */
-    /* buffers button presses internally */
-    timer_add(drv_GLCD2USB_timer, NULL, 100, 0);
+    for (i = 1; i + 1 < report->len && i + 1 < len; i += 2)
+	if (bytes[i] != report->bytes[i] || bytes[i + 1] != report->bytes[i + 1])
+	    mismatch |= 1 << (i / 2);
 
-    if (cfg_number(section, "Brightness", 0, 0, 255, &brightness) > 0) {
-	drv_GLCD2USB_brightness(brightness);
+    if (mismatch) {
+	info("%s: display %s doesn't show what it should, sending pages %x again", Name,
+	     d->select ? d->select : "(any)", mismatch);
+	pthread_mutex_lock(&d->queue.mutex);
+	d->queue.mismatch |= mismatch;
+	pthread_mutex_unlock(&d->queue.mutex);
     }
 
     return 0;
 }
 
+/* a display got lost (unplugged, reset, ...). instead of waiting for */
+/* every report to time out, nothing is sent to it until it's reopened */
+static void drv_GLCD2USB_disconnect(device_t * d)
+{
+    error("%s: lost display %s, trying to reopen it", Name, d->select ? d->select : "(any)");
 
+    drv_GLCD2USB_release(d);
 
-/****************************************/
-/***            plugins               ***/
-/****************************************/
+    /* the queued reports are replaced by a resync after reopening */
+    pthread_mutex_lock(&d->queue.mutex);
+    d->queue.offline = 1;
+    d->queue.count = 0;
+    d->queue.mismatch = 0;
+    pthread_mutex_unlock(&d->queue.mutex);
 
-static void plugin_brightness(RESULT * result, RESULT * arg1)
+    /* the other displays don't wait for it to show their frames */
+    drv_GLCD2USB_frame_signal();
+}
+
+/* try to open a lost display again. it has to be the same kind of */
+/* display. the main thread then sends it all its contents again */
+static void drv_GLCD2USB_reconnect(device_t * d)
 {
-    double brightness;
+    display_info_t info;
+    int len = sizeof(info);
 
-    brightness = drv_GLCD2USB_brightness(R2N(arg1));
-    SetResult(&result, R_NUMBER, &brightness);
+    if (drv_GLCD2USB_find(d) != 0)
+	return;
+
+    memset(&info, 0, sizeof(info));
+    if (usbGetReport(d->dev, USB_HID_REPORT_TYPE_FEATURE, GLCD2USB_RID_GET_INFO, (unsigned char *) &info, &len) != 0 ||
+	len < (int) offsetof(display_info_t, flags2) || info.width != d->width || info.height != d->height ||
+	info.flags != d->flags || info.flags2 != d->flags2 || drv_GLCD2USB_allocate(d, 0) != 0) {
+	drv_GLCD2USB_release(d);
+	return;
+    }
+
+    info("%s: reopened display %s", Name, d->select ? d->select : "(any)");
+
+    pthread_mutex_lock(&d->queue.mutex);
+    d->queue.offline = 0;
+    d->queue.resync = 1;
+    d->queue.button_events = (d->flags & FLAG_BUTTON_EVENTS) ? 1 : 0;
+    d->queue.button_errors = 0;
+    pthread_mutex_unlock(&d->queue.mutex);
 }
 
-/****************************************/
-/***        widget callbacks          ***/
-/****************************************/
+static void *drv_GLCD2USB_worker(void *arg)
+{
+    device_t *d = arg;
+    report_t report;
+    struct timespec poll, retry;
+    int err;
 
+    drv_GLCD2USB_deadline(&poll, 0);
+
+    pthread_mutex_lock(&d->queue.mutex);
+    for (;;) {
+	/* old firmware is asked for the button state regularly */
+	if (!d->queue.offline && !d->queue.button_events && !d->queue.quit && drv_GLCD2USB_passed(&poll)) {
+	    drv_GLCD2USB_deadline(&poll, POLL_INTERVAL);
+	    pthread_mutex_unlock(&d->queue.mutex);
+	    if (drv_GLCD2USB_button_poll(d) != 0)
+		drv_GLCD2USB_disconnect(d);
+	    pthread_mutex_lock(&d->queue.mutex);
+	    continue;
+	}
 
-/* using drv_generic_graphic_draw(W) */
-/* using drv_generic_graphic_icon_draw(W) */
-/* using drv_generic_graphic_bar_draw(W) */
+	/* retry opening a lost display until it's back */
+	if (d->queue.offline) {
+	    drv_GLCD2USB_deadline(&retry, RETRY_INTERVAL);
+	    while (!d->queue.quit && pthread_cond_timedwait(&d->queue.cond, &d->queue.mutex, &retry) != ETIMEDOUT);
+	    if (d->queue.quit)
+		break;
+
+	    pthread_mutex_unlock(&d->queue.mutex);
+	    drv_GLCD2USB_reconnect(d);
+	    pthread_mutex_lock(&d->queue.mutex);
+	    continue;
+	}
 
+	if (!d->queue.count) {
+	    /* only leave once everything has been sent */
+	    if (d->queue.quit)
+		break;
+
+	    if (d->queue.button_events) {
+		pthread_mutex_unlock(&d->queue.mutex);
+		drv_GLCD2USB_button_read(d);
+		pthread_mutex_lock(&d->queue.mutex);
+	    } else
+		pthread_cond_timedwait(&d->queue.cond, &d->queue.mutex, &poll);
+	    continue;
+	}
 
-/****************************************/
-/***        exported functions        ***/
-/****************************************/
+	report = d->queue.report[d->queue.head];
+	d->queue.head = (d->queue.head + 1) % QUEUE_SIZE;
+	d->queue.count--;
 
+	if (!report.len)
+	    continue;
 
-/* list models */
-int drv_GLCD2USB_list(void)
+	if (report.bytes[0] != GLCD2USB_RID_COMMIT)
+	    d->queue.sending = report.frame;
+	pthread_mutex_unlock(&d->queue.mutex);
+
+	if (report.bytes[0] == GLCD2USB_RID_COMMIT && devices > 1)
+	    drv_GLCD2USB_frame_wait(d, report.frame);
+
+	if (report.bytes[0] == GLCD2USB_RID_GET_CRC)
+	    err = drv_GLCD2USB_crc_check(d, &report);
+	else if ((err = usbSetReport(d->dev, USB_HID_REPORT_TYPE_FEATURE, report.bytes, report.len)) != 0)
+	    error("%s: Error sending report %d: %s", Name, report.bytes[0], usbErrorMessage(err));
+
+	pthread_mutex_lock(&d->queue.mutex);
+	d->queue.sending = 0;
+
+	if (err) {
+	    pthread_mutex_unlock(&d->queue.mutex);
+	    drv_GLCD2USB_disconnect(d);
+	    pthread_mutex_lock(&d->queue.mutex);
+	}
+
+	/* other displays may be waiting for this data to show a frame */
+	else if (report.bytes[0] != GLCD2USB_RID_COMMIT && devices > 1) {
+	    pthread_mutex_unlock(&d->queue.mutex);
+	    drv_GLCD2USB_frame_signal();
+	    pthread_mutex_lock(&d->queue.mutex);
+	}
+    }
+    pthread_mutex_unlock(&d->queue.mutex);
+
+    return NULL;
+}
+
+/* max. number of segments in a multi write report */
+#define MULTI_SEGMENTS  ((128 + 4 - 1) / (GLCD2USB_MULTI_HEADER + 1))
+
+/* areas of display memory written by a report, returns the number */
+/* of areas. reports not writing to the display memory have none */
+static int drv_GLCD2USB_span(const unsigned char *bytes, const int len, int *start, int *end)
 {
-    printf("GLCD2USB homebrew USB interface for graphic displays");
+    int i, n;
+
+    switch (bytes[0]) {
+    case GLCD2USB_RID_WRITE:
+	start[0] = bytes[1] + 256 * bytes[2];
+	end[0] = start[0] + bytes[3];
+	return 1;
+
+    case GLCD2USB_RID_WRITE_RLE:
+	/* sum up the decoded lengths of all rle chunks */
+	start[0] = end[0] = bytes[1] + 256 * bytes[2];
+	for (i = 0; i < bytes[3];) {
+	    end[0] += (bytes[4 + i] & ~GLCD2USB_RLE_REPEAT) + 1;
+	    i += (bytes[4 + i] & GLCD2USB_RLE_REPEAT) ? 2 : (bytes[4 + i] + 2);
+	}
+	return 1;
+
+    case GLCD2USB_RID_WRITE_MULTI:
+    case GLCD2USB_RID_TEXT:
+	for (n = 0, i = 1; n < MULTI_SEGMENTS && i + GLCD2USB_MULTI_HEADER <= len && bytes[i + 2]; n++) {
+	    start[n] = bytes[i] + 256 * bytes[i + 1];
+	    end[n] = start[n] + bytes[i + 2] * ((bytes[0] == GLCD2USB_RID_TEXT) ? GLCD2USB_TEXT_WIDTH : 1);
+	    i += GLCD2USB_MULTI_HEADER + bytes[i + 2];
+	}
+	return n;
+    }
+
     return 0;
 }
 
-static int drv_GLCD2USB_keypad(const int num)
+/* do the areas of two reports overlap? */
+static int drv_GLCD2USB_overlap(const int n, const int *start, const int *end, const int m, const int *s, const int *e)
 {
-    const int keys[] = { WIDGET_KEY_LEFT, WIDGET_KEY_RIGHT,
-	WIDGET_KEY_CONFIRM, WIDGET_KEY_CANCEL
-    };
+    int i, j;
 
-    int val;
+    for (i = 0; i < n; i++)
+	for (j = 0; j < m; j++)
+	    if (e[j] > start[i] && s[j] < end[i])
+		return 1;
 
-    /* check for key press event */
-    if (num & 0x80)
-	val = WIDGET_KEY_PRESSED;
-    else
-	val = WIDGET_KEY_RELEASED;
+    return 0;
+}
 
-    return val | keys[num & 0x03];
+/* are all areas of report s/e contained in areas of report start/end? */
+static int drv_GLCD2USB_covered(const int n, const int *start, const int *end, const int m, const int *s, const int *e)
+{
+    int i, j;
+
+    for (j = 0; j < m; j++) {
+	for (i = 0; i < n && (start[i] > s[j] || end[i] < e[j]); i++);
+	if (i == n)
+	    return 0;
+    }
+
+    return 1;
 }
 
-/* initialize driver & display */
-int drv_GLCD2USB_init(const char *section, const __attribute__ ((unused))
-		      int quiet)
+/* queue a report for the i/o thread. a write report replaces queued */
+/* but unsent write reports whose bytes it completely overwrites. frame */
+/* ends queued in between are dropped then, the frames are merged */
+static void drv_GLCD2USB_submit(device_t * d, const unsigned char *bytes, const int len)
 {
-    int ret;
+    int start[MULTI_SEGMENTS], end[MULTI_SEGMENTS], s[MULTI_SEGMENTS], e[MULTI_SEGMENTS];
+    int i, n, m, write, patched = 0, commits = 0;
+    report_t *report, *commit[QUEUE_SIZE];
 
-    info("%s: %s", Name, "$Rev: 1144 $");
+    write = drv_GLCD2USB_span(bytes, len, start, end);
 
-    /* real worker functions */
-    drv_generic_graphic_real_blit = drv_GLCD2USB_blit;
-    drv_generic_keypad_real_press = drv_GLCD2USB_keypad;
+    pthread_mutex_lock(&d->queue.mutex);
 
-    /* start display */
-    if ((ret = drv_GLCD2USB_start(section)) != 0)
-	return ret;
+    /* a lost display gets everything sent again once it's back */
+    if (d->queue.offline) {
+	pthread_mutex_unlock(&d->queue.mutex);
+	return;
+    }
 
-    /* initialize generic graphic driver */
-    if ((ret = drv_generic_graphic_init(section, Name)) != 0)
-	return ret;
+    /* search from newest to oldest queued report */
+    for (n = d->queue.count - 1; write && n >= 0; n--) {
+	report = &d->queue.report[(d->queue.head + n) % QUEUE_SIZE];
+	if (report->len && report->bytes[0] == GLCD2USB_RID_COMMIT) {
+	    commit[commits++] = report;
+	    continue;
+	}
 
-    /* initialize generic key pad driver */
-    if ((ret = drv_generic_keypad_init(section, Name)) != 0)
-	return ret;
+	/* the crcs requested are those of the data queued before */
+	if (report->len && report->bytes[0] == GLCD2USB_RID_GET_CRC)
+	    break;
 
-    /* register plugins */
-    AddFunction("LCD::brightness", 1, plugin_brightness);
+	if (!report->len || !(m = drv_GLCD2USB_span(report->bytes, report->len, s, e)))
+	    continue;
 
-    return 0;
+	if (!drv_GLCD2USB_overlap(write, start, end, m, s, e))
+	    continue;
+
+	/* the most recent overlapping report contains all of the new */
+	/* bytes: just update it as nothing queued later touches them */
+	if (!patched && bytes[0] == GLCD2USB_RID_WRITE &&
+	    report->bytes[0] == GLCD2USB_RID_WRITE && s[0] <= start[0] && e[0] >= end[0]) {
+	    memcpy(report->bytes + 4 + start[0] - s[0], bytes + 4, end[0] - start[0]);
+	    d->queue.superseded += end[0] - start[0];
+	    patched = 1;
+	}
+
+	/* an older report completely overwritten by the new one */
+	else if (drv_GLCD2USB_covered(write, start, end, m, s, e)) {
+	    for (i = 0; i < m; i++)
+		d->queue.superseded += e[i] - s[i];
+	    report->len = 0;
+	}
+
+	/* partial overlap, both reports are needed */
+	else {
+	    patched |= 2;
+	    continue;
+	}
+
+	/* the older frames now contain data of the new one. they are */
+	/* shown together with it as a single frame */
+	for (; commits > 0; commits--)
+	    commit[commits - 1]->len = 0;
+
+	/* only the newest overlapping report may be updated in place */
+	patched |= 2;
+    }
+
+    if (!(patched & 1)) {
+	if (d->queue.count == QUEUE_SIZE) {
+	    /* no more room: data will be sent with one of the next updates */
+	    d->queue.dropped += len;
+	    if (bytes[0] == GLCD2USB_RID_COMMIT)
+		d->commit_pending = 1;
+	    if (bytes[0] == GLCD2USB_RID_SCROLL)
+		d->scroll_sent = -1;
+	    for (i = 0; i < write; i++) {
+		memset(d->dirty_buffer + start[i], 1, end[i] - start[i]);
+		if (start[i] < d->dirty_lo)
+		    d->dirty_lo = start[i];
+		if (end[i] > d->dirty_hi)
+		    d->dirty_hi = end[i];
+	    }
+	} else {
+	    report = &d->queue.report[(d->queue.head + d->queue.count) % QUEUE_SIZE];
+	    memcpy(report->bytes, bytes, len);
+	    report->len = len;
+	    report->frame = frames + 1;
+	    d->queue.count++;
+	    pthread_cond_signal(&d->queue.cond);
+	}
+    }
+
+    pthread_mutex_unlock(&d->queue.mutex);
 }
 
+static int drv_GLCD2USB_queue_start(device_t * d)
+{
+    memset(&d->queue, 0, sizeof(d->queue));
+    pthread_mutex_init(&d->queue.mutex, NULL);
+    pthread_cond_init(&d->queue.cond, NULL);
+    d->queue.button_events = (d->flags & FLAG_BUTTON_EVENTS) ? 1 : 0;
 
-/* close driver & display */
-int drv_GLCD2USB_quit(const __attribute__ ((unused))
-		      int quiet)
+    if (pthread_create(&d->queue.thread, NULL, drv_GLCD2USB_worker, d) != 0) {
+	error("%s: unable to start i/o thread", Name);
+	return -1;
+    }
+
+    d->queue.running = 1;
+    return 0;
+}
+
+/* send everything still queued and stop the i/o thread */
+static void drv_GLCD2USB_queue_stop(device_t * d)
 {
-    int err;
+    if (!d->queue.running)
+	return;
 
-    info("%s: shutting down.", Name);
-    drv_generic_graphic_quit();
+    pthread_mutex_lock(&d->queue.mutex);
+    d->queue.quit = 1;
+    pthread_cond_signal(&d->queue.cond);
+    pthread_mutex_unlock(&d->queue.mutex);
 
-    drv_generic_keypad_quit();
+    pthread_join(d->queue.thread, NULL);
+    d->queue.running = 0;
+}
 
-    /* release access to display */
+/* ------------------------------------------------------------------------- */
 
-    buffer.bytes[0] = GLCD2USB_RID_SET_ALLOC;
-    buffer.bytes[1] = 0;	/* 1=alloc, 0=free */
-    if ((err = usbSetReport(dev, USB_HID_REPORT_TYPE_FEATURE, buffer.bytes, 2)) != 0) {
-	error("%s Error freeing display: %s", Name, usbErrorMessage(err));
+/* merge one packed row of page bytes into the offscreen buffer and */
+/* mark every byte that actually changed as dirty */
+static void drv_GLCD2USB_update(device_t * d, const int offset, const unsigned char *data, const int len)
+{
+    unsigned char *vb = d->video_buffer + offset;
+    unsigned char *db = d->dirty_buffer + offset;
+    unsigned long old, new;
+    int i, j;
+
+    /* compare a whole machine word at a time, most of a redraw */
+    /* usually is identical to what's already on the display */
+    for (i = 0; i + (int) sizeof(unsigned long) <= len; i += sizeof(unsigned long)) {
+	memcpy(&old, vb + i, sizeof(unsigned long));
+	memcpy(&new, data + i, sizeof(unsigned long));
+	if (old == new)
+	    continue;
+
+	for (j = i; j < i + (int) sizeof(unsigned long); j++)
+	    if (vb[j] != data[j])
+		db[j] = 1;
     }
 
-    /* clean up */
-    if (dev != NULL)
-	usbCloseDevice(dev);
+    /* remaining bytes at the end of the row */
+    for (; i < len; i++)
+	if (vb[i] != data[i])
+	    db[i] = 1;
+
+    memcpy(vb, data, len);
 
-    if (video_buffer != NULL) {
-	free(video_buffer);
-	free(dirty_buffer);
+    /* the area checked for dirty bytes by the next flush */
+    if (offset < d->dirty_lo)
+	d->dirty_lo = offset;
+    if (offset + len > d->dirty_hi)
+	d->dirty_hi = offset + len;
+}
+
+static void drv_GLCD2USB_plan_init(device_t * d, const int transfer_cost, const int byte_cost)
+{
+    int len, size = 4;
+
+    cost_transfer = transfer_cost;
+    cost_byte = byte_cost;
+
+    for (len = 1; len <= 128; len++) {
+	if (len > size)
+	    size *= 2;
+	d->plan_cost_table[len] = transfer_cost + byte_cost * (size + 4);
+
+	/* runs are packed into multi write reports, so each of them only */
+	/* costs its segment and its share of the transfer overhead */
+	if (d->flags & FLAG_MULTI)
+	    d->plan_cost_table[len] = (transfer_cost + byte_cost * (128 + 4)) *
+		(len + GLCD2USB_MULTI_HEADER) / (128 + 4 - 1);
     }
 
+    d->plan_rle_cost[0] = transfer_cost + byte_cost * (16 + 4);
+    d->plan_rle_cost[1] = transfer_cost + byte_cost * (64 + 4);
+}
+
+/* choose the set of runs that covers all dirty bytes between lo and hi */
+/* with the lowest estimated total wire time. runs may include clean bytes */
+/* if that saves a transfer or doesn't cost anything due to padding */
+static void drv_GLCD2USB_plan(device_t * d, const int lo, const int hi)
+{
+    int i, end, cost;
+
+    d->plan_cost[hi] = 0;
+
+    for (i = hi - 1; i >= lo; i--) {
+	/* clean bytes don't need to be covered */
+	if (!d->dirty_buffer[i]) {
+	    d->plan_next[i] = -1;
+	    d->plan_cost[i] = d->plan_cost[i + 1];
+	    continue;
+	}
+
+	/* a run starting here ends right behind one of the next dirty bytes */
+	d->plan_next[i] = -1;
+	for (end = i + 1; end <= hi && end <= i + 128; end++) {
+	    if (!d->dirty_buffer[end - 1])
+		continue;
+
+	    cost = d->plan_cost_table[end - i] + d->plan_cost[end];
+	    if (d->plan_next[i] < 0 || cost < d->plan_cost[i]) {
+		d->plan_next[i] = end;
+		d->plan_cost[i] = cost;
+	    }
+	}
+    }
+}
+
+/* run length encode len bytes. returns the encoded length or -1 */
+/* if the result doesn't fit into max bytes */
+static int drv_GLCD2USB_rle(const unsigned char *data, const int len, unsigned char *out, const int max)
+{
+    int i = 0, n, o = 0;
+
+    while (i < len) {
+	/* length of the run starting here */
+	for (n = 1; i + n < len && n < 128 && data[i + n] == data[i]; n++);
+
+	if (n >= 3) {
+	    if (o + 2 > max)
+		return -1;
+	    out[o++] = GLCD2USB_RLE_REPEAT | (n - 1);
+	    out[o++] = data[i];
+	    i += n;
+	    continue;
+	}
+
+	/* literal bytes up to the next run of at least three bytes */
+	for (n = 1; i + n < len && n < 128; n++)
+	    if (i + n + 2 < len && data[i + n] == data[i + n + 1] && data[i + n] == data[i + n + 2])
+		break;
+
+	if (o + 1 + n > max)
+	    return -1;
+	out[o++] = n - 1;
+	memcpy(out + o, data + i, n);
+	o += n;
+	i += n;
+    }
+
+    return o;
+}
+
+/* try to replace the planned runs starting at offset start by a single */
+/* rle report. returns the end of the area covered or -1 if that's not */
+/* cheaper than sending the runs as they are */
+static int drv_GLCD2USB_flush_rle(device_t * d, const int start, const int hi)
+{
+    unsigned char bytes[64 + 4];
+    int i, len, end = -1, raw = 0, saved = 0;
+
+    for (i = start; i < hi;) {
+	if (d->plan_next[i] < 0) {
+	    i++;
+	    continue;
+	}
+
+	/* cost of the next planned run */
+	raw += d->plan_cost_table[d->plan_next[i] - i];
+	i = d->plan_next[i];
+
+	if ((len = drv_GLCD2USB_rle(d->video_buffer + start, i - start, bytes + 4, 64)) < 0)
+	    break;
+
+	if (raw - d->plan_rle_cost[len > 16] > saved) {
+	    saved = raw - d->plan_rle_cost[len > 16];
+	    end = i;
+	    bytes[3] = len;
+	}
+    }
+
+    if (end < 0)
+	return -1;
+
+    bytes[0] = GLCD2USB_RID_WRITE_RLE;
+    bytes[1] = start % 256;	// offset
+    bytes[2] = start / 256;
+    drv_GLCD2USB_rle(d->video_buffer + start, end - start, bytes + 4, 64);
+
+    memset(d->dirty_buffer + start, 0, end - start);
+    drv_GLCD2USB_submit(d, bytes, bytes[3] + 4);
+
+    return end;
+}
+
+/* queue the segments collected in a multi write report. a single */
+/* segment has the layout of a plain write report and is sent as such */
+static void drv_GLCD2USB_flush_multi(device_t * d, unsigned char *bytes, const int len)
+{
+    if (len <= 1)
+	return;
+
+    if (len == 1 + GLCD2USB_MULTI_HEADER + bytes[3])
+	bytes[0] = GLCD2USB_RID_WRITE;
+    else
+	bytes[0] = GLCD2USB_RID_WRITE_MULTI;
+
+    drv_GLCD2USB_submit(d, bytes, len);
+}
+
+/* the character of the display's font a cell of 6 columns shows, -1 if none */
+static int drv_GLCD2USB_glyph(const unsigned char *data)
+{
+    int c;
+
+    if (data[GLCD2USB_TEXT_WIDTH - 1])
+	return -1;
+
+    for (c = 0; c < GLCD2USB_FONT_CHARS; c++)
+	if (!memcmp(data, glcd2usb_font[c], GLCD2USB_TEXT_WIDTH - 1))
+	    return c + GLCD2USB_FONT_FIRST;
+
+    return -1;
+}
+
+/* a changed cell of a text line may be sent as a character */
+static void drv_GLCD2USB_text_mark(device_t * d, const int offset)
+{
+    unsigned char *db = d->dirty_buffer + offset;
+    int i;
+
+    for (i = 0; i < GLCD2USB_TEXT_WIDTH && !db[i]; i++);
+
+    if (i == GLCD2USB_TEXT_WIDTH || drv_GLCD2USB_glyph(d->video_buffer + offset) < 0)
+	return;
+
+    db[0] = DIRTY_TEXT;
+    memset(db + 1, DIRTY_TEXT_CELL, GLCD2USB_TEXT_WIDTH - 1);
+}
+
+/* estimated cost of sending n characters as pixel data instead */
+static int drv_GLCD2USB_text_cost(device_t * d, int n)
+{
+    int cost = 0;
+
+    for (n *= GLCD2USB_TEXT_WIDTH; n > 0; n -= 128)
+	cost += d->plan_cost_table[n > 128 ? 128 : n];
+
+    return cost;
+}
+
+/* collect the characters marked between lo and hi in text reports */
+/* and queue them if send is set. returns the estimated time saved */
+/* compared to sending the same cells as pixel data */
+static int drv_GLCD2USB_text(device_t * d, const int lo, const int hi, const int send)
+{
+    unsigned char bytes[64 + 4];
+    int i, c, len = 1, seg = 0, reports = 0, saved = 0;
+
+    bytes[0] = GLCD2USB_RID_TEXT;
+
+    for (i = lo; i < hi; i++) {
+	if (d->dirty_buffer[i] != DIRTY_TEXT || (c = drv_GLCD2USB_glyph(d->video_buffer + i)) < 0)
+	    continue;
+
+	/* start a new segment unless the character continues the last one */
+	if (!seg || i != bytes[seg] + 256 * bytes[seg + 1] + bytes[seg + 2] * GLCD2USB_TEXT_WIDTH ||
+	    len == 64 + 4) {
+	    if (len + GLCD2USB_MULTI_HEADER + 1 > 64 + 4) {
+		if (send)
+		    drv_GLCD2USB_submit(d, bytes, len);
+		reports++;
+		len = 1;
+	    }
+
+	    if (seg)
+		saved += drv_GLCD2USB_text_cost(d, bytes[seg + 2]);
+
+	    seg = len;
+	    bytes[len++] = i % 256;	// offset
+	    bytes[len++] = i / 256;
+	    bytes[len++] = 0;	// length
+	}
+
+	bytes[len++] = c;
+	bytes[seg + 2]++;
+
+	if (send)
+	    memset(d->dirty_buffer + i, 0, GLCD2USB_TEXT_WIDTH);
+	i += GLCD2USB_TEXT_WIDTH - 1;
+    }
+
+    if (!seg)
+	return 0;
+
+    if (send)
+	drv_GLCD2USB_submit(d, bytes, len);
+
+    saved += drv_GLCD2USB_text_cost(d, bytes[seg + 2]);
+    return saved - (reports + 1) * (cost_transfer + cost_byte * (64 + 4));
+}
+
+/* send the cells marked as text as characters if that's cheaper. all */
+/* other cells are sent as pixel data like any other dirty byte */
+static void drv_GLCD2USB_flush_text(device_t * d, const int lo, const int hi)
+{
+    int i;
+
+    if (drv_GLCD2USB_text(d, lo, hi, 0) > 0)
+	drv_GLCD2USB_text(d, lo, hi, 1);
+
+    for (i = lo; i < hi; i++)
+	if (d->dirty_buffer[i])
+	    d->dirty_buffer[i] = 1;
+}
+
+/* mark the end of a frame. displays supporting it keep showing the */
+/* last complete frame until then. returns whether a report was queued */
+static int drv_GLCD2USB_commit(device_t * d)
+{
+    unsigned char bytes[2];
+
+    d->commit_pending = 0;
+    if (!(d->flags2 & FLAG2_COMMIT))
+	return 0;
+
+    bytes[0] = GLCD2USB_RID_COMMIT;
+    bytes[1] = 1;		/* keep holding back writes */
+    drv_GLCD2USB_submit(d, bytes, 2);
+    return 1;
+}
+
+/* plan and queue the transmission of everything that's dirty. */
+/* returns whether anything has been queued */
+static int drv_GLCD2USB_flush(device_t * d)
+{
+    unsigned char bytes[128 + 4], multi[128 + 4];
+    int i, lo, hi, end, len, multi_len = 1, queued = 0;
+
+    /* move the display contents before the rows scrolled in are sent */
+    if (d->scroll != d->scroll_sent) {
+	bytes[0] = GLCD2USB_RID_SCROLL;
+	bytes[1] = d->scroll;
+	d->scroll_sent = d->scroll;
+	d->commit_pending = 1;
+	drv_GLCD2USB_submit(d, bytes, 2);
+	queued = 1;
+    }
+
+    /* find the area that needs to be transmitted */
+    for (lo = d->dirty_lo; lo < d->dirty_hi && !d->dirty_buffer[lo]; lo++);
+    for (hi = d->dirty_hi; hi > lo && !d->dirty_buffer[hi - 1]; hi--);
+
+    d->dirty_lo = d->width * d->height / 8;
+    d->dirty_hi = 0;
+
+    if (lo >= hi) {
+	if (d->commit_pending)
+	    queued |= drv_GLCD2USB_commit(d);
+	return queued;
+    }
+
+    if (d->text_enabled)
+	drv_GLCD2USB_flush_text(d, lo, hi);
+
+    drv_GLCD2USB_plan(d, lo, hi);
+
+    for (i = lo; i < hi;) {
+	/* clean byte not covered by any run */
+	if (d->plan_next[i] < 0) {
+	    i++;
+	    continue;
+	}
+
+	/* compressed data may be cheaper for the next few runs */
+	if ((d->flags & FLAG_RLE) && (end = drv_GLCD2USB_flush_rle(d, i, hi)) >= 0) {
+	    i = end;
+	    continue;
+	}
+
+	len = d->plan_next[i] - i;
+
+	/* these entries aren't dirty anymore */
+	memset(d->dirty_buffer + i, 0, len);
+
+	/* collect as many runs as possible in one multi write report */
+	if (d->flags & FLAG_MULTI) {
+	    if (multi_len + GLCD2USB_MULTI_HEADER + len > 128 + 4) {
+		drv_GLCD2USB_flush_multi(d, multi, multi_len);
+		multi_len = 1;
+	    }
+
+	    multi[multi_len++] = i % 256;	// offset
+	    multi[multi_len++] = i / 256;
+	    multi[multi_len++] = len;	// length
+	    memcpy(multi + multi_len, d->video_buffer + i, len);
+	    multi_len += len;
+
+	    i += len;
+	    continue;
+	}
+
+	bytes[0] = GLCD2USB_RID_WRITE;
+	bytes[1] = i % 256;	// offset
+	bytes[2] = i / 256;
+	bytes[3] = len;		// length
+	memcpy(bytes + 4, d->video_buffer + i, len);
+	drv_GLCD2USB_submit(d, bytes, len + 4);
+
+	i += len;
+    }
+
+    drv_GLCD2USB_flush_multi(d, multi, multi_len);
+    drv_GLCD2USB_commit(d);
+    return 1;
+}
+
+static void drv_GLCD2USB_flush_all(void)
+{
+    int i, queued = 0;
+
+    for (i = 0; i < devices; i++)
+	queued |= drv_GLCD2USB_flush(&device[i]);
+
+    /* nothing changed, the next change may be sent right away */
+    if (!queued)
+	return;
+
+    gettimeofday(&last_flush, NULL);
+
+    /* the frame is complete, it may be shown once all data is sent */
+    pthread_mutex_lock(&frame_mutex);
+    frames++;
+    pthread_cond_broadcast(&frame_cond);
+    pthread_mutex_unlock(&frame_mutex);
+}
+
+static void drv_GLCD2USB_flush_timer(void __attribute__ ((unused)) * notused)
+{
+    flush_pending = 0;
+    drv_GLCD2USB_flush_all();
+}
+
+/* flush right away unless the last flush was less than one frame */
+/* interval ago. in that case collect further changes until it's over */
+static void drv_GLCD2USB_schedule(void)
+{
+    struct timeval now;
+    int elapsed;
+
+    if (flush_pending)
+	return;
+
+    gettimeofday(&now, NULL);
+    elapsed = (now.tv_sec - last_flush.tv_sec) * 1000 + (now.tv_usec - last_flush.tv_usec) / 1000;
+
+    if (elapsed < 0 || elapsed >= frame_interval) {
+	drv_GLCD2USB_flush_all();
+	return;
+    }
+
+    flush_pending = 1;
+    timer_add(drv_GLCD2USB_flush_timer, NULL, frame_interval - elapsed, 1);
+}
+
+/* lay the bit rows in scroll_new out like the offscreen buffer for */
+/* start line scroll. returns the number of bytes differing from the */
+/* offscreen buffer. frame may be NULL to only count them */
+static int drv_GLCD2USB_scroll_layout(device_t * d, const int scroll, unsigned char *frame)
+{
+    int x, r, page, row[8], bytes = (d->width + 7) / 8, dirty = 0;
+
+    for (page = 0; page < d->height / 8; page++) {
+	for (r = 0; r < 8; r++)
+	    row[r] = ((page * 8 + r - scroll + d->height) % d->height) * bytes;
+
+	for (x = 0; x < d->width; x++) {
+	    unsigned char bits = 0;
+
+	    for (r = 7; r >= 0; r--)
+		bits = (bits << 1) | ((d->scroll_new[row[r] + x / 8] & (1 << (x % 8))) ? 1 : 0);
+
+	    if (bits != d->video_buffer[d->width * page + x])
+		dirty++;
+	    if (frame)
+		frame[d->width * page + x] = bits;
+	}
+    }
+
+    return dirty;
+}
+
+/* a redraw of the whole display may just move its contents up or */
+/* down. then setting the start line of the display and sending the */
+/* rows that scrolled in is cheaper than sending everything again. */
+/* the framebuffer is read once into scroll_frame, laid out like the */
+/* offscreen buffer, which the blit then takes the pages from */
+static void drv_GLCD2USB_scroll_detect(device_t * d)
+{
+    unsigned int *hash_old = d->scroll_hash, *hash_new = d->scroll_hash + d->height;
+    unsigned char *frame = d->scroll_frame, *vb = d->video_buffer;
+    int x, y, k, r, line, page, row[8], bytes = (d->width + 7) / 8, dirty = 0, match, best = 0, best_match = 0;
+
+    for (page = 0; page < d->height / 8; page++) {
+	for (r = 0; r < 8; r++)
+	    row[r] = d->y + (page * 8 + r - d->scroll + d->height) % d->height;
+
+	for (x = 0; x < d->width; x++) {
+	    unsigned char bits = 0;
+
+	    for (r = 7; r >= 0; r--)
+		bits = (bits << 1) | (drv_generic_graphic_black(row[r], d->x + x) ? 1 : 0);
+
+	    frame[d->width * page + x] = bits;
+	    if (bits != vb[d->width * page + x])
+		dirty++;
+	}
+    }
+
+    /* even if scrolling left no byte to send it wouldn't outweigh the */
+    /* additional report, e.g. if nothing or just a few digits changed */
+    if (dirty * cost_byte <= cost_transfer)
+	return;
+
+    /* bit rows of what's currently shown and of what's to be shown. */
+    /* memory line l is shown in row l - scroll */
+    memset(d->scroll_old, 0, d->height * bytes);
+    memset(d->scroll_new, 0, d->height * bytes);
+    for (line = 0; line < d->height; line += 8) {
+	for (x = 0; x < d->width; x++) {
+	    for (r = 0; r < 8; r++) {
+		y = (line + r - d->scroll + d->height) % d->height;
+		if (vb[d->width * (line / 8) + x] & (1 << r))
+		    d->scroll_old[y * bytes + x / 8] |= 1 << (x % 8);
+		if (frame[d->width * (line / 8) + x] & (1 << r))
+		    d->scroll_new[y * bytes + x / 8] |= 1 << (x % 8);
+	    }
+	}
+    }
+
+    /* rows are only compared byte by byte if their hashes match */
+    for (y = 0; y < d->height; y++) {
+	hash_old[y] = hash_new[y] = 2166136261u;
+	for (x = 0; x < bytes; x++) {
+	    hash_old[y] = (hash_old[y] ^ d->scroll_old[y * bytes + x]) * 16777619u;
+	    hash_new[y] = (hash_new[y] ^ d->scroll_new[y * bytes + x]) * 16777619u;
+	}
+    }
+
+    /* number of rows already in place when moving up by k rows */
+    for (k = 1; k < d->height; k++) {
+	match = 0;
+	for (y = 0; y < d->height; y++) {
+	    line = (y + k) % d->height;
+	    if (hash_new[y] == hash_old[line] &&
+		!memcmp(d->scroll_new + y * bytes, d->scroll_old + line * bytes, bytes))
+		match++;
+	}
+
+	if (match > best_match) {
+	    best = k;
+	    best_match = match;
+	}
+    }
+
+    /* the bytes saved need to outweigh the additional report. a row */
+    /* moved into place doesn't save anything if other rows of its page */
+    /* still differ, so count the bytes left to send for each page */
+    if (!best || (dirty - drv_GLCD2USB_scroll_layout(d, (d->scroll + best) % d->height, NULL)) * cost_byte <= cost_transfer)
+	return;
+
+    /* lay the frame out for the new start line */
+    d->scroll = (d->scroll + best) % d->height;
+    drv_GLCD2USB_scroll_layout(d, d->scroll, frame);
+}
+
+/* update the offscreen buffer of a display from an area of its tile */
+static void drv_GLCD2USB_blit_device(device_t * d, const int row, const int col, const int height, const int width)
+{
+    int r, c, page, y[8], full = 0;
+
+    /* a full redraw is taken from the frame read by the scroll detection */
+    if (row == 0 && col == 0 && height == d->height && width == d->width && (d->flags2 & FLAG2_SCROLL)) {
+	drv_GLCD2USB_scroll_detect(d);
+	full = 1;
+    }
+
+    /* update offscreen buffer one display page (8 pixel rows) at a time */
+    for (page = 0; page < d->height / 8; page++) {
+	/* these assignments are display layout dependent. display */
+	/* memory line l is shown in row l - scroll of the display */
+	unsigned char mask = 0;
+	unsigned char *vb = d->video_buffer + d->width * page + col;
+
+	for (r = 0; r < 8; r++) {
+	    y[r] = (page * 8 + r - d->scroll + d->height) % d->height;
+	    if (y[r] >= row && y[r] < row + height)
+		mask |= 1 << r;
+	}
+
+	if (!mask)
+	    continue;
+
+	/* build each column byte in a register instead of doing a */
+	/* read-modify-write on the offscreen buffer for every pixel */
+	if (full)
+	    memcpy(d->page_buffer, d->scroll_frame + d->width * page, width);
+	else
+	    for (c = 0; c < width; c++) {
+		unsigned char bits = 0;
+
+		for (r = 7; r >= 0; r--)
+		    bits = (bits << 1) | ((mask & (1 << r)) &&
+					  drv_generic_graphic_black(d->y + y[r], d->x + col + c) ? 1 : 0);
+
+		d->page_buffer[c] = (vb[c] & ~mask) | bits;
+	    }
+
+	drv_GLCD2USB_update(d, d->width * page + col, d->page_buffer, width);
+
+	/* text lines fill complete pages */
+	if (d->text_enabled && mask == 0xff)
+	    for (c = 0; c + GLCD2USB_TEXT_WIDTH <= width; c += GLCD2USB_TEXT_WIDTH)
+		drv_GLCD2USB_text_mark(d, d->width * page + col + c);
+    }
+
+#if 0
+    /* display what's in the buffer (for debugging) */
+    for (r = 0; r < d->height; r++) {
+	for (c = 0; c < d->width; c++) {
+	    if (d->video_buffer[c + d->width * (((r + d->scroll) % d->height) / 8)] & (1 << ((r + d->scroll) % 8)))
+		putchar('#');
+	    else
+		putchar(' ');
+	}
+	putchar('\n');
+    }
+#endif
+}
+
+static void drv_GLCD2USB_blit(const int row, const int col, const int height, const int width)
+{
+    device_t *d;
+    int i, r0, c0, r1, c1;
+
+    /* the part of the area on each display's tile */
+    for (i = 0; i < devices; i++) {
+	d = &device[i];
+	r0 = (row > d->y) ? row : d->y;
+	c0 = (col > d->x) ? col : d->x;
+	r1 = (row + height < d->y + d->height) ? row + height : d->y + d->height;
+	c1 = (col + width < d->x + d->width) ? col + width : d->x + d->width;
+
+	if (r0 < r1 && c0 < c1)
+	    drv_GLCD2USB_blit_device(d, r0 - d->y, c0 - d->x, r1 - r0, c1 - c0);
+    }
+
+    drv_GLCD2USB_schedule();
+}
+
+static int drv_GLCD2USB_brightness(int brightness)
+{
+    unsigned char bytes[2];
+    int i;
+
+    printf("setting bright to %d\n", brightness);
+
+    if (brightness < 0)
+	brightness = 0;
+    if (brightness > 255)
+	brightness = 255;
+
+    backlight = brightness;
+
+    bytes[0] = GLCD2USB_RID_SET_BL;
+    bytes[1] = brightness;
+    for (i = 0; i < devices; i++)
+	drv_GLCD2USB_submit(&device[i], bytes, 2);
+
+    return brightness;
+}
+
+/* a reopened display has been cleared by allocating it. send it all */
+/* that isn't blank, its start line and backlight again */
+static void drv_GLCD2USB_resync(device_t * d)
+{
+    unsigned char bytes[2];
+    int i, resync, size = d->width * d->height / 8;
+
+    pthread_mutex_lock(&d->queue.mutex);
+    resync = d->queue.resync;
+    d->queue.resync = 0;
+    pthread_mutex_unlock(&d->queue.mutex);
+
+    if (!resync)
+	return;
+
+    for (i = 0; i < size; i++)
+	if (d->video_buffer[i])
+	    d->dirty_buffer[i] = 1;
+    d->dirty_lo = 0;
+    d->dirty_hi = size;
+
+    d->scroll_sent = 0;
+    d->commit_pending = 1;
+
+    if (backlight >= 0) {
+	bytes[0] = GLCD2USB_RID_SET_BL;
+	bytes[1] = backlight;
+	drv_GLCD2USB_submit(d, bytes, 2);
+    }
+}
+
+/* queue a request for the crcs of the display memory together with */
+/* the crcs of the offscreen buffer, once everything has been queued */
+static void drv_GLCD2USB_crc_request(device_t * d)
+{
+    unsigned char bytes[1 + 2 * GLCD2USB_CRC_PAGES];
+    unsigned short crc;
+    struct timeval now;
+    int i, n, elapsed, size = d->width * d->height / 8;
+
+    if (!(d->flags2 & FLAG2_CRC) || d->dirty_lo < d->dirty_hi || d->commit_pending || d->scroll != d->scroll_sent)
+	return;
+
+    gettimeofday(&now, NULL);
+    elapsed = (now.tv_sec - d->last_verify.tv_sec) * 1000 + (now.tv_usec - d->last_verify.tv_usec) / 1000;
+    if (elapsed >= 0 && elapsed < verify_interval)
+	return;
+
+    d->last_verify = now;
+
+    bytes[0] = GLCD2USB_RID_GET_CRC;
+    for (n = 0; n < GLCD2USB_CRC_PAGES && n * GLCD2USB_CRC_PAGE < size; n++) {
+	crc = 0xffff;
+	for (i = n * GLCD2USB_CRC_PAGE; i < (n + 1) * GLCD2USB_CRC_PAGE && i < size; i++)
+	    crc = glcd2usb_crc(crc, d->video_buffer[i]);
+	bytes[1 + 2 * n] = crc & 0xff;
+	bytes[2 + 2 * n] = crc >> 8;
+    }
+
+    drv_GLCD2USB_submit(d, bytes, 1 + 2 * n);
+}
+
+/* mark the pages dirty whose crcs didn't match */
+static void drv_GLCD2USB_crc_repair(device_t * d)
+{
+    unsigned int mismatch;
+    int n, start, end, size = d->width * d->height / 8;
+
+    pthread_mutex_lock(&d->queue.mutex);
+    mismatch = d->queue.mismatch;
+    d->queue.mismatch = 0;
+    pthread_mutex_unlock(&d->queue.mutex);
+
+    for (n = 0; mismatch; n++, mismatch >>= 1) {
+	if (!(mismatch & 1))
+	    continue;
+
+	start = n * GLCD2USB_CRC_PAGE;
+	end = (start + GLCD2USB_CRC_PAGE < size) ? start + GLCD2USB_CRC_PAGE : size;
+	memset(d->dirty_buffer + start, 1, end - start);
+	if (start < d->dirty_lo)
+	    d->dirty_lo = start;
+	if (end > d->dirty_hi)
+	    d->dirty_hi = end;
+    }
+}
+
+/* turn the button states received from a display into keypad events */
+static void drv_GLCD2USB_buttons(device_t * d)
+{
+    unsigned char state[BUTTON_QUEUE_SIZE];
+    int n = 0, i, j;
+
+    /* fetch the button states received or polled by the i/o thread */
+    pthread_mutex_lock(&d->queue.mutex);
+    for (; d->queue.button_count; d->queue.button_count--) {
+	state[n++] = d->queue.button[d->queue.button_head];
+	d->queue.button_head = (d->queue.button_head + 1) % BUTTON_QUEUE_SIZE;
+    }
+    pthread_mutex_unlock(&d->queue.mutex);
+
+    for (j = 0; j < n; j++) {
+	/* check if button state changed */
+	if (state[j] ^ d->last_but) {
+
+	    /* send single keypad events for all changed buttons */
+	    for (i = 0; i < 4; i++)
+		if ((state[j] & (1 << i)) ^ (d->last_but & (1 << i)))
+		    drv_generic_keypad_press(((state[j] & (1 << i)) ? 0x80 : 0) | i);
+	}
+
+	d->last_but = state[j];
+    }
+}
+
+static void drv_GLCD2USB_timer(void __attribute__ ((unused)) * notused)
+{
+    int i;
+
+    for (i = 0; i < devices; i++) {
+	drv_GLCD2USB_resync(&device[i]);
+	drv_GLCD2USB_crc_repair(&device[i]);
+	drv_GLCD2USB_buttons(&device[i]);
+    }
+
+    /* send whatever didn't fit into the queue during the last update */
+    /* or has to be sent again to a display */
+    drv_GLCD2USB_schedule();
+
+    /* check now and then whether the displays show what they should */
+    if (verify_interval)
+	for (i = 0; i < devices; i++)
+	    drv_GLCD2USB_crc_request(&device[i]);
+}
+
+/* file keeping the contents of a display while the driver isn't running */
+static void drv_GLCD2USB_shadow_name(device_t * d, char *name, const int size)
+{
+    char *c;
+    int len;
+
+    len = snprintf(name, size, "%s/%s-", shadow_dir, Name);
+    if (len >= size)
+	len = size - 1;
+    snprintf(name + len, size - len, "%s.shadow", d->select ? d->select : "any");
+
+    /* a bus path contains a slash */
+    for (c = name + len; *c; c++)
+	if (*c == '/')
+	    *c = '-';
+}
+
+/* save the contents of a display and its start line when the driver */
+/* stops. a display freed keeping its contents still shows them on the */
+/* next start, which then only has to send what differs from them */
+static int drv_GLCD2USB_shadow_save(device_t * d)
+{
+    char name[256];
+    FILE *f;
+    int i, err, size = d->width * d->height / 8;
+
+    /* it's not known what the display shows where updates didn't get out */
+    for (i = d->dirty_lo; i < d->dirty_hi; i++)
+	if (d->dirty_buffer[i])
+	    return -1;
+    if (d->scroll != d->scroll_sent || d->queue.mismatch)
+	return -1;
+
+    /* the parent directory (e.g. /run) is expected to exist */
+    mkdir(shadow_dir, 0755);
+
+    drv_GLCD2USB_shadow_name(d, name, sizeof(name));
+    if ((f = fopen(name, "wb")) == NULL) {
+	error("%s: cannot save display contents to %s: %s", Name, name, strerror(errno));
+	return -1;
+    }
+    fprintf(f, IDENT_PRODUCT_STRING " %d %d %d\n", d->width, d->height, d->scroll);
+    err = fwrite(d->video_buffer, size, 1, f) != 1;
+    if (fclose(f) != 0 || err) {
+	error("%s: cannot save display contents to %s", Name, name);
+	unlink(name);
+	return -1;
+    }
+
+    return 0;
+}
+
+/* load the contents saved for a display into the offscreen buffer. */
+/* the file is removed, they are unknown once the display gets updated */
+static int drv_GLCD2USB_shadow_load(device_t * d)
+{
+    char name[256], line[64];
+    FILE *f;
+    int width, height, scroll, ok, size = d->width * d->height / 8;
+
+    drv_GLCD2USB_shadow_name(d, name, sizeof(name));
+    if ((f = fopen(name, "rb")) == NULL)
+	return -1;
+
+    ok = fgets(line, sizeof(line), f) != NULL &&
+	sscanf(line, IDENT_PRODUCT_STRING " %d %d %d", &width, &height, &scroll) == 3 &&
+	width == d->width && height == d->height && scroll >= 0 && scroll < d->height &&
+	fread(d->video_buffer, size, 1, f) == 1;
+    fclose(f);
+    unlink(name);
+
+    if (!ok) {
+	error("%s: ignoring bad display contents in %s", Name, name);
+	memset(d->video_buffer, 0, size);
+	return -1;
+    }
+
+    d->scroll = d->scroll_sent = scroll;
+    return 0;
+}
+
+/* free the offscreen buffer of a display and its helpers */
+static void drv_GLCD2USB_free_buffers(device_t * d)
+{
+    if (d->video_buffer == NULL)
+	return;
+
+    free(d->video_buffer);
+    free(d->dirty_buffer);
+    free(d->page_buffer);
+    free(d->plan_next);
+    free(d->plan_cost);
+    free(d->scroll_frame);
+    free(d->scroll_old);
+    free(d->scroll_new);
+    free(d->scroll_hash);
+    d->video_buffer = NULL;
+}
+
+/* open a display and set it up for use by the driver */
+static int drv_GLCD2USB_open(device_t * d, const int text, const int transfer_cost, const int byte_cost)
+{
+    int err = 0, len, size, keep;
+
+    if ((err = drv_GLCD2USB_find(d)) != 0) {
+	error("%s: opening GLCD2USB device %s: %s", Name, d->select ? d->select : "", usbErrorMessage(err));
+	return -1;
+    }
+
+    if (d->select)
+	info("%s: Found device %s", Name, d->select);
+    else
+	info("%s: Found device", Name);
+
+    /* query display parameters */
+    memset(&buffer, 0, sizeof(buffer));
+
+    len = sizeof(display_info_t);
+    if ((err = usbGetReport(d->dev, USB_HID_REPORT_TYPE_FEATURE, GLCD2USB_RID_GET_INFO, buffer.bytes, &len)) != 0) {
+
+	error("%s: query display parameters: %s", Name, usbErrorMessage(err));
+	drv_GLCD2USB_release(d);
+	return -1;
+    }
+
+    /* older firmware doesn't send the second flags byte */
+    if (len < (int) offsetof(display_info_t, flags2)) {
+	error("%s: Not enough bytes in display info report (%d instead of %d)",
+	      Name, len, (int) sizeof(buffer.display_info));
+	drv_GLCD2USB_release(d);
+	return -1;
+    }
+
+    info("%s: display name = %s", Name, buffer.display_info.name);
+    info("%s: display resolution = %d * %d", Name, buffer.display_info.width, buffer.display_info.height);
+    info("%s: display flags: %x %x", Name, buffer.display_info.flags, buffer.display_info.flags2);
+
+    /* TODO: check for supported features */
+
+
+    /* save display size */
+    d->width = buffer.display_info.width;
+    d->height = buffer.display_info.height;
+    d->flags = buffer.display_info.flags;
+    d->flags2 = buffer.display_info.flags2;
+
+    /* the display's font can only replace a host font of the same size */
+    if (text && (d->flags2 & FLAG2_TEXT)) {
+	if (XRES == GLCD2USB_TEXT_WIDTH && YRES == 8)
+	    d->text_enabled = 1;
+	else
+	    info("%s: font %dx%d doesn't match the display's font, not using it", Name, XRES, YRES);
+    }
+
+    /* the cost of a run depends on the write reports supported */
+    drv_GLCD2USB_plan_init(d, transfer_cost, byte_cost);
+
+    /* allocate a offscreen buffer */
+    size = d->width * d->height / 8;
+    d->video_buffer = malloc(size);
+    d->dirty_buffer = malloc(size);
+    d->page_buffer = malloc(d->width);
+    d->plan_next = malloc((size + 1) * sizeof(int));
+    d->plan_cost = malloc((size + 1) * sizeof(int));
+    d->scroll_frame = malloc(size);
+    d->scroll_old = malloc(d->height * ((d->width + 7) / 8));
+    d->scroll_new = malloc(d->height * ((d->width + 7) / 8));
+    d->scroll_hash = malloc(2 * d->height * sizeof(unsigned int));
+    memset(d->video_buffer, 0, size);
+    memset(d->dirty_buffer, 0, size);
+    d->dirty_lo = size;
+    d->dirty_hi = 0;
+
+    /* a display may still show what the driver left on it */
+    keep = shadow_dir != NULL && (d->flags2 & FLAG2_KEEP) && drv_GLCD2USB_shadow_load(d) == 0;
+
+    /* on failure undo the setup in reverse order */
+    if (drv_GLCD2USB_allocate(d, keep) != 0) {
+	drv_GLCD2USB_free_buffers(d);
+	drv_GLCD2USB_release(d);
+	return -1;
+    }
+
+    if (drv_GLCD2USB_queue_start(d) != 0) {
+	drv_GLCD2USB_deallocate(d, 0);
+	drv_GLCD2USB_free_buffers(d);
+	drv_GLCD2USB_release(d);
+	return -1;
+    }
+
+    /* make sure it does, it may have been replugged meanwhile. the */
+    /* crcs don't cover the start line, it's simply sent again */
+    if (keep) {
+	info("%s: keeping the display contents", Name);
+	drv_GLCD2USB_crc_request(d);
+	if (d->flags2 & FLAG2_SCROLL)
+	    d->scroll_sent = -1;
+    }
+
+    return 0;
+}
+
+/* send everything still queued, release and close a display */
+static void drv_GLCD2USB_close(device_t * d)
+{
+    int keep;
+
+    drv_GLCD2USB_queue_stop(d);
+
+    /* release access to display */
+    if (d->dev != NULL) {
+	/* it keeps showing its contents if they could be saved */
+	keep = shadow_dir != NULL && (d->flags2 & FLAG2_KEEP) && drv_GLCD2USB_shadow_save(d) == 0;
+	drv_GLCD2USB_deallocate(d, keep);
+	drv_GLCD2USB_release(d);
+    }
+
+    drv_GLCD2USB_free_buffers(d);
+
+    free(d->select);
+    d->select = NULL;
+}
+
+static int drv_GLCD2USB_start(const char *section)
+{
+    int brightness, transfer_cost, byte_cost, fps, text, verify, columns, rows;
+    char key[32], *s;
+    int i;
+
+    if (sscanf(s = cfg_get(section, "font", "6x8"), "%dx%d", &XRES, &YRES) != 2 || XRES < 1 || YRES < 1) {
+	error("%s: bad %s.Font '%s' from %s", Name, section, s, cfg_source());
+	free(s);
+	return -1;
+    }
+    free(s);
+
+    /* cost model used to plan the write reports */
+    cfg_number(section, "TransferCost", 1000, 0, 1000000, &transfer_cost);
+    cfg_number(section, "ByteCost", 8, 0, 10000, &byte_cost);
+
+    if (cfg_number(section, "MaxFPS", 0, 0, 1000, &fps) > 0 && fps > 0)
+	frame_interval = 1000 / fps;
+
+    cfg_number(section, "FirmwareFont", 0, 0, 1, &text);
+
+    if (cfg_number(section, "Verify", 0, 0, 3600, &verify) > 0)
+	verify_interval = 1000 * verify;
+
+    free(shadow_dir);
+    if (*(shadow_dir = cfg_get(section, "ShadowDir", "")) == '\0') {
+	free(shadow_dir);
+	shadow_dir = NULL;
+    }
+
+    /* the displays to use. without any, the first one found is used */
+    memset(device, 0, sizeof(device));
+    for (devices = 0; devices < MAX_DEVICES; devices++) {
+	snprintf(key, sizeof(key), "Device%d", devices + 1);
+	if ((s = cfg_get(section, key, NULL)) == NULL || *s == '\0') {
+	    free(s);
+	    break;
+	}
+	device[devices].select = s;
+    }
+    if (devices == 0)
+	devices = 1;
+
+    if (sscanf(s = cfg_get(section, "Tiles", "1x1"), "%dx%d", &columns, &rows) != 2 || columns < 1 || rows < 1 ||
+	(columns * rows > 1 && columns * rows != devices)) {
+	error("%s: bad %s.Tiles '%s' from %s for %d displays", Name, section, s, cfg_source(), devices);
+	free(s);
+	for (i = 0; i < devices; i++)
+	    free(device[i].select);
+	devices = 0;
+	return -1;
+    }
+    free(s);
+
+    for (i = 0; i < devices; i++) {
+	if (drv_GLCD2USB_open(&device[i], text, transfer_cost, byte_cost) != 0)
+	    break;
+
+	/* tiles are placed row by row */
+	if (columns * rows > 1) {
+	    device[i].x = (i % columns) * device[0].width;
+	    device[i].y = (i / columns) * device[0].height;
+	}
+
+	if (i && (device[i].width != device[0].width || device[i].height != device[0].height)) {
+	    error("%s: display %s is %dx%d, not %dx%d like the first one", Name,
+		  device[i].select, device[i].width, device[i].height, device[0].width, device[0].height);
+	    drv_GLCD2USB_close(&device[i]);
+	    break;
+	}
+    }
+
+    if (i < devices) {
+	while (--i >= 0)
+	    drv_GLCD2USB_close(&device[i]);
+	for (i = 0; i < devices; i++)
+	    free(device[i].select);
+	devices = 0;
+	return -1;
+    }
+
+    /* save display size */
+    DCOLS = columns * device[0].width;
+    DROWS = rows * device[0].height;
+
+    /* regularly process key events. old firmware is polled for the key */
+    /* state less often, the device buffers button presses internally */
+    timer_add(drv_GLCD2USB_timer, NULL, TIMER_INTERVAL, 0);
+
+    if (cfg_number(section, "Brightness", 0, 0, 255, &brightness) > 0) {
+	drv_GLCD2USB_brightness(brightness);
+    }
+
+    return 0;
+}
+
+
+
+/****************************************/
+/***            plugins               ***/
+/****************************************/
+
+static void plugin_brightness(RESULT * result, RESULT * arg1)
+{
+    double brightness;
+
+    brightness = drv_GLCD2USB_brightness(R2N(arg1));
+    SetResult(&result, R_NUMBER, &brightness);
+}
+
+static void plugin_queue(RESULT * result)
+{
+    double depth = 0;
+    int i;
+
+    /* sum of all displays */
+    for (i = 0; i < devices; i++) {
+	pthread_mutex_lock(&device[i].queue.mutex);
+	depth += device[i].queue.count;
+	pthread_mutex_unlock(&device[i].queue.mutex);
+    }
+
+    SetResult(&result, R_NUMBER, &depth);
+}
+
+static void plugin_superseded(RESULT * result)
+{
+    double bytes = 0;
+    int i;
+
+    /* sum of all displays */
+    for (i = 0; i < devices; i++) {
+	pthread_mutex_lock(&device[i].queue.mutex);
+	bytes += device[i].queue.superseded;
+	pthread_mutex_unlock(&device[i].queue.mutex);
+    }
+
+    SetResult(&result, R_NUMBER, &bytes);
+}
+
+static void plugin_dropped(RESULT * result)
+{
+    double bytes = 0;
+    int i;
+
+    /* sum of all displays */
+    for (i = 0; i < devices; i++) {
+	pthread_mutex_lock(&device[i].queue.mutex);
+	bytes += device[i].queue.dropped;
+	pthread_mutex_unlock(&device[i].queue.mutex);
+    }
+
+    SetResult(&result, R_NUMBER, &bytes);
+}
+
+/****************************************/
+/***        widget callbacks          ***/
+/****************************************/
+
+
+/* using drv_generic_graphic_draw(W) */
+/* using drv_generic_graphic_icon_draw(W) */
+/* using drv_generic_graphic_bar_draw(W) */
+
+
+/****************************************/
+/***        exported functions        ***/
+/****************************************/
+
+
+/* list models */
+int drv_GLCD2USB_list(void)
+{
+    printf("GLCD2USB homebrew USB interface for graphic displays");
+    return 0;
+}
+
+static int drv_GLCD2USB_keypad(const int num)
+{
+    const int keys[] = { WIDGET_KEY_LEFT, WIDGET_KEY_RIGHT,
+	WIDGET_KEY_CONFIRM, WIDGET_KEY_CANCEL
+    };
+
+    int val;
+
+    /* check for key press event */
+    if (num & 0x80)
+	val = WIDGET_KEY_PRESSED;
+    else
+	val = WIDGET_KEY_RELEASED;
+
+    return val | keys[num & 0x03];
+}
+
+/* initialize driver & display */
+int drv_GLCD2USB_init(const char *section, const __attribute__ ((unused))
+		      int quiet)
+{
+    int ret;
+
+    info("%s: %s", Name, "$Rev: 1144 $");
+
+    /* real worker functions */
+    drv_generic_graphic_real_blit = drv_GLCD2USB_blit;
+    drv_generic_keypad_real_press = drv_GLCD2USB_keypad;
+
+    /* start display */
+    if ((ret = drv_GLCD2USB_start(section)) != 0)
+	return ret;
+
+    /* initialize generic graphic driver */
+    if ((ret = drv_generic_graphic_init(section, Name)) != 0)
+	return ret;
+
+    /* initialize generic key pad driver */
+    if ((ret = drv_generic_keypad_init(section, Name)) != 0)
+	return ret;
+
+    /* register plugins */
+    AddFunction("LCD::brightness", 1, plugin_brightness);
+    AddFunction("LCD::queue", 0, plugin_queue);
+    AddFunction("LCD::superseded", 0, plugin_superseded);
+    AddFunction("LCD::dropped", 0, plugin_dropped);
+
+    return 0;
+}
+
+
+/* close driver & display */
+int drv_GLCD2USB_quit(const __attribute__ ((unused))
+		      int quiet)
+{
+    int i;
+
+    info("%s: shutting down.", Name);
+    drv_generic_graphic_quit();
+
+    drv_generic_keypad_quit();
+
+    /* wait for all pending updates to be sent */
+    drv_GLCD2USB_flush_all();
+
+    for (i = 0; i < devices; i++)
+	drv_GLCD2USB_close(&device[i]);
+    devices = 0;
+
+    free(shadow_dir);
+    shadow_dir = NULL;
+
     return (0);
 }
 
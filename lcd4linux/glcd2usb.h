@@ -10,6 +10,17 @@
 #define FLAG_BOTTOM_START     (1<<2)
 #define FLAG_VERTICAL_INC     (1<<3)
 #define FLAG_BACKLIGHT        (1<<4)
+#define FLAG_RLE              (1<<5)
+#define FLAG_BUTTON_EVENTS    (1<<6)
+#define FLAG_MULTI            (1<<7)
+
+/* features reported in the second flags byte */
+#define FLAG2_COMMIT          (1<<0)
+#define FLAG2_SCROLL          (1<<1)
+#define FLAG2_TEXT            (1<<2)
+#define FLAG2_DRAW            (1<<3)
+#define FLAG2_CRC             (1<<4)
+#define FLAG2_KEEP            (1<<5)
 
 #define GLCD2USB_RID_GET_INFO      1	/* get display info */
 #define GLCD2USB_RID_SET_ALLOC     2	/* allocate/free display */
@@ -23,12 +34,97 @@
 #define GLCD2USB_RID_WRITE_32      (GLCD2USB_RID_WRITE+3)
 #define GLCD2USB_RID_WRITE_64      (GLCD2USB_RID_WRITE+4)
 #define GLCD2USB_RID_WRITE_128     (GLCD2USB_RID_WRITE+5)
+#define GLCD2USB_RID_WRITE_RLE    14	/* write run length encoded bitmap data */
+#define GLCD2USB_RID_WRITE_RLE_16  (GLCD2USB_RID_WRITE_RLE+0)
+#define GLCD2USB_RID_WRITE_RLE_64  (GLCD2USB_RID_WRITE_RLE+1)
+#define GLCD2USB_RID_WRITE_MULTI  16	/* write several segments of bitmap data */
+#define GLCD2USB_RID_WRITE_MULTI_64  (GLCD2USB_RID_WRITE_MULTI+0)
+#define GLCD2USB_RID_WRITE_MULTI_128 (GLCD2USB_RID_WRITE_MULTI+1)
+#define GLCD2USB_RID_COMMIT       18	/* show all data written so far */
+#define GLCD2USB_RID_SCROLL       19	/* set the display start line */
+#define GLCD2USB_RID_TEXT         20	/* write text using the display's font */
+#define GLCD2USB_RID_DRAW         21	/* draw lines, rectangles and circles */
+#define GLCD2USB_RID_GET_CRC      22	/* get crcs of the display memory */
+
+/* the alloc report's value allocates (1) or frees (0) the display. */
+/* with GLCD2USB_ALLOC_KEEP (only if FLAG2_KEEP is reported) the */
+/* display memory and start line are kept, and freeing the display */
+/* doesn't start the screen saver. this lets a restarting host keep */
+/* the display contents */
+#define GLCD2USB_ALLOC_ON     (1<<0)
+#define GLCD2USB_ALLOC_KEEP   (1<<1)
+
+/* the rle write report has the same header as the plain write report */
+/* (offset and length of the encoded data). the encoded data consists */
+/* of chunks starting with a control byte c. for c < 128 c+1 literal */
+/* bytes follow. for c >= 128 the next byte is to be repeated c-127 times */
+#define GLCD2USB_RLE_REPEAT   0x80
+
+/* the multi write report carries a sequence of segments, each consisting */
+/* of a two byte offset, a length byte and the data. a segment of length */
+/* 0 (e.g. the zero padding of the report) ends the sequence */
+#define GLCD2USB_MULTI_HEADER 3
+
+/* after a commit report with a value of 1 the display keeps showing */
+/* the committed frame until the next commit. a value of 0 shows all */
+/* writes immediately again (the default) */
+
+/* the scroll report sets the display memory line shown in the top row */
+/* of the display. while frames are held it takes effect with the next */
+/* commit. allocating the display resets it to 0 unless it's kept */
+
+/* the text report uses the segment format of the multi write report */
+/* (64 data bytes). a segment's data are characters which the display */
+/* draws with its built-in 5x7 font, 6 columns per character incl. the */
+/* spacing. only ascii 0x20-0x7f is available */
+#define GLCD2USB_TEXT_WIDTH   6
+
+/* the draw report carries a sequence of drawing commands. each starts */
+/* with a byte combining the primitive and the drawing mode, followed by */
+/* its coordinates in display memory (i.e. they move with the start line */
+/* like the writes do). a 0 byte (e.g. the padding) ends the sequence. */
+/* the coordinates are 8 bit, dots outside the display are not drawn */
+#define GLCD2USB_DRAW_SIZE    32	/* command bytes per report */
+
+#define GLCD2USB_DRAW_LINE    1		/* x1, y1, x2, y2 */
+#define GLCD2USB_DRAW_RECT    2		/* x, y, width, height: outline */
+#define GLCD2USB_DRAW_FILL    3		/* x, y, width, height: filled */
+#define GLCD2USB_DRAW_CIRCLE  4		/* x, y, radius */
+#define GLCD2USB_DRAW_PRIMITIVE  0x0f
+
+#define GLCD2USB_DRAW_SET     0x00	/* dots are set */
+#define GLCD2USB_DRAW_CLEAR   0x10	/* dots are cleared */
+#define GLCD2USB_DRAW_XOR     0x20	/* dots are inverted */
+#define GLCD2USB_DRAW_MODE    0x30
+
+/* number of coordinate bytes following the command byte */
+#define GLCD2USB_DRAW_ARGS(c)  ((((c) & GLCD2USB_DRAW_PRIMITIVE) == GLCD2USB_DRAW_CIRCLE) ? 3 : 4)
+
+/* the crc report contains a crc of every 128 bytes of display memory */
+/* (in the order of the write offsets), low byte first. entries beyond */
+/* the end of the display memory are 0. setting the report (just its */
+/* id) requests the crcs, the display computes them in the background */
+/* and lets the host wait until getting the report returns them. they */
+/* include everything written before the request, also if it's not */
+/* committed yet */
+#define GLCD2USB_CRC_PAGE     128	/* bytes per crc */
+#define GLCD2USB_CRC_PAGES    16	/* crcs per report */
+
+/* CRC-16/CCITT like avr-libc's _crc_ccitt_update(), starting with */
+/* 0xffff for every page */
+static inline unsigned short glcd2usb_crc(unsigned short crc, unsigned char data)
+{
+    data ^= crc & 0xff;
+    data ^= data << 4;
+    return ((((unsigned short) data << 8) | (crc >> 8)) ^ (unsigned char) (data >> 4) ^ ((unsigned short) data << 3));
+}
 
 typedef struct {
     unsigned char report_id;
     char name[32];
     unsigned short width, height;
     unsigned char flags;
+    unsigned char flags2;	/* not sent by older firmware */
 } __attribute__ ((packed)) display_info_t;
 
 #endif				// GLCD2USB_H
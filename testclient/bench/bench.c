@@ -0,0 +1,266 @@
+/* Name: bench.c
+ * Project: GLCD2USB
+ * Author: Till Harbaum
+ * Licensed under GPL
+ */
+
+/*
+General Description:
+Measures the host side cost of the lcd4linux driver (drv_GLCD2USB.c): the
+blit comparing lcd4linux' framebuffer with the offscreen buffer, planning
+the write reports and queueing them. The driver is linked against the
+stand-ins for the lcd4linux headers in this directory and against the
+virtual device (virtual.c) which doesn't take any transfer time. Only the
+cpu time of the thread calling the driver counts, not that of its i/o
+thread.
+
+  make bench && ./glcd2usb-bench [WIDTHxHEIGHT [frames]]
+
+To get the numbers before a change, build it against an older revision of
+the driver (make only compares timestamps, so remove the binary first):
+
+  git show <rev>:lcd4linux/drv_GLCD2USB.c > /tmp/drv_GLCD2USB.c
+  rm -f glcd2usb-bench && make bench BENCH_DRIVER=/tmp/drv_GLCD2USB.c
+
+Each scene is drawn for the given number of frames (200), the result is
+the average time per frame in ns:
+
+  unchanged   the whole display is redrawn without any change
+  clock       a few small areas change, like the digits of a clock
+  noise       the whole display changes
+  scroll      the contents move up by a text line, a new one comes in
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "drv.h"
+#include "plugin.h"
+#include "drv_generic_graphic.h"
+#include "drv_generic_keypad.h"
+
+extern DRIVER   drv_GLCD2USB;
+
+#define MAX_TIMERS  8
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------- lcd4linux stand-ins --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+int     DROWS, DCOLS, XRES, YRES;
+
+void    (*drv_generic_graphic_real_blit) (const int row, const int col, const int height, const int width);
+int     (*drv_generic_keypad_real_press) (const int num);
+
+static unsigned char    *framebuffer;
+
+int drv_generic_graphic_black(const int row, const int col)
+{
+    return framebuffer[row * DCOLS + col];
+}
+
+int drv_generic_graphic_init(const char *section, const char *driver)
+{
+    return 0;
+}
+
+int drv_generic_graphic_quit(void)
+{
+    return 0;
+}
+
+int drv_generic_keypad_init(const char *section, const char *driver)
+{
+    return 0;
+}
+
+void    drv_generic_keypad_quit(void)
+{
+}
+
+int drv_generic_keypad_press(const int num)
+{
+    return 0;
+}
+
+/* all options have their default values */
+char    *cfg_get(const char *section, const char *key, const char *defval)
+{
+    return defval ? strdup(defval) : NULL;
+}
+
+int cfg_number(const char *section, const char *key, const int defval, const int min, const int max, int *value)
+{
+    *value = defval;
+    return 0;
+}
+
+char    *cfg_source(void)
+{
+    return "bench";
+}
+
+static struct {
+    void    (*callback) (void *data);
+    void    *data;
+    int     oneShot;
+} timer[MAX_TIMERS];
+
+int timer_add(void (*callback) (void *data), void *data, const int interval, const int one_shot)
+{
+int     i;
+
+    for(i=0;i<MAX_TIMERS;i++){
+        if(timer[i].callback == NULL){
+            timer[i].callback = callback;
+            timer[i].data = data;
+            timer[i].oneShot = one_shot;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int timer_remove(void (*callback) (void *data), void *data)
+{
+    return 0;
+}
+
+/* the intervals don't matter, the timers just run between the frames */
+static void benchTimers(void)
+{
+void    (*callback) (void *data);
+int     i;
+
+    for(i=0;i<MAX_TIMERS;i++){
+        if((callback = timer[i].callback) != NULL){
+            if(timer[i].oneShot)
+                timer[i].callback = NULL;
+            callback(timer[i].data);
+        }
+    }
+}
+
+double  R2N(RESULT * result)
+{
+    return result->number;
+}
+
+char    *R2S(RESULT * result)
+{
+    return "";
+}
+
+void    SetResult(RESULT ** result, int type, void *value)
+{
+}
+
+int AddFunction(const char *name, int args, void *function)
+{
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* -------------------------------- scenes --------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static void sceneUnchanged(int frame)
+{
+    drv_generic_graphic_real_blit(0, 0, DROWS, DCOLS);
+}
+
+static void sceneClock(int frame)
+{
+int     i, x, y, r, c;
+
+    for(i=0;i<12;i++){
+        x = rand() % (DCOLS - 5);
+        y = rand() % (DROWS - 7);
+        for(r=y;r<y+7;r++)
+            for(c=x;c<x+5;c++)
+                framebuffer[r * DCOLS + c] = rand() & 1;
+        drv_generic_graphic_real_blit(y, x, 7, 5);
+    }
+}
+
+static void sceneNoise(int frame)
+{
+int     i;
+
+    for(i=0;i<DROWS*DCOLS;i++)
+        framebuffer[i] = rand() & 1;
+    drv_generic_graphic_real_blit(0, 0, DROWS, DCOLS);
+}
+
+static void sceneScroll(int frame)
+{
+int     i;
+
+    memmove(framebuffer, framebuffer + 8 * DCOLS, (DROWS - 8) * DCOLS);
+    for(i=(DROWS-8)*DCOLS;i<DROWS*DCOLS;i++)
+        framebuffer[i] = rand() & 1;
+    drv_generic_graphic_real_blit(0, 0, DROWS, DCOLS);
+}
+
+static struct {
+    const char  *name;
+    void        (*draw)(int frame);
+} scene[] = {
+    { "unchanged",  sceneUnchanged },
+    { "clock",      sceneClock },
+    { "noise",      sceneNoise },
+    { "scroll",     sceneScroll },
+};
+
+static double   benchTime(void)
+{
+struct timespec t;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+int     frames = 200, i, f;
+double  start, total;
+
+    if(argc > 1)
+        setenv("GLCD2USB_SIZE", argv[1], 1);
+    if(argc > 2 && (frames = atoi(argv[2])) < 1){
+        fprintf(stderr, "usage: %s [WIDTHxHEIGHT [frames]]\n", argv[0]);
+        return 1;
+    }
+    setenv("GLCD2USB_TRANSFER_US", "0", 1);
+    setenv("GLCD2USB_BYTE_US", "0", 1);
+
+    if(drv_GLCD2USB.init("Display:bench", 1) != 0)
+        return 1;
+    framebuffer = calloc(DROWS * DCOLS, 1);
+
+    printf("%dx%d, %d frames per scene\n", DCOLS, DROWS, frames);
+    for(i=0;i<sizeof(scene)/sizeof(scene[0]);i++){
+        srand(1);
+        total = 0;
+        for(f=0;f<frames;f++){
+            start = benchTime();
+            scene[i].draw(f);
+            total += benchTime() - start;
+
+            /* let the i/o thread send the frame. it may be waiting for a
+             * button event for up to 10ms (BUTTON_TIMEOUT), meanwhile the
+             * queue would overflow and the driver send everything again */
+            benchTimers();
+            usleep(12000);
+        }
+        printf("%-10s %10.0f ns/frame\n", scene[i].name, total / frames);
+    }
+
+    drv_GLCD2USB.quit(1);
+    free(framebuffer);
+    return 0;
+}
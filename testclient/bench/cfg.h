@@ -0,0 +1,12 @@
+/*
+ * cfg.h - stand-in for the lcd4linux header, the driver options of the bench (see bench.c)
+ */
+
+#ifndef BENCH_CFG_H
+#define BENCH_CFG_H
+
+char *cfg_get(const char *section, const char *key, const char *defval);
+int cfg_number(const char *section, const char *key, const int defval, const int min, const int max, int *value);
+char *cfg_source(void);
+
+#endif
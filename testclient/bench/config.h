@@ -0,0 +1,4 @@
+/*
+ * config.h - stand-in for the lcd4linux header, the bench has no build configuration
+ */
+
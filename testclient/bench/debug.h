@@ -0,0 +1,13 @@
+/*
+ * debug.h - stand-in for the lcd4linux header, driver messages go to stderr
+ */
+
+#ifndef BENCH_DEBUG_H
+#define BENCH_DEBUG_H
+
+#include <stdio.h>
+
+#define info(args...)   (fprintf(stderr, args), fputc('\n', stderr))
+#define error(args...)  (fprintf(stderr, args), fputc('\n', stderr))
+
+#endif
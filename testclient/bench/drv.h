@@ -0,0 +1,15 @@
+/*
+ * drv.h - stand-in for the lcd4linux header, the driver interface
+ */
+
+#ifndef BENCH_DRV_H
+#define BENCH_DRV_H
+
+typedef struct DRIVER {
+    char *name;
+    int (*list) (void);
+    int (*init) (const char *section, const int quiet);
+    int (*quit) (const int quiet);
+} DRIVER;
+
+#endif
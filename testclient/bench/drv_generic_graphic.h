@@ -0,0 +1,16 @@
+/*
+ * drv_generic_graphic.h - stand-in for the lcd4linux header, the framebuffer of the bench (see bench.c)
+ */
+
+#ifndef BENCH_DRV_GENERIC_GRAPHIC_H
+#define BENCH_DRV_GENERIC_GRAPHIC_H
+
+extern int DROWS, DCOLS, XRES, YRES;
+
+extern void (*drv_generic_graphic_real_blit) (const int row, const int col, const int height, const int width);
+
+int drv_generic_graphic_black(const int row, const int col);
+int drv_generic_graphic_init(const char *section, const char *driver);
+int drv_generic_graphic_quit(void);
+
+#endif
@@ -0,0 +1,14 @@
+/*
+ * drv_generic_keypad.h - stand-in for the lcd4linux header, the bench doesn't press any keys
+ */
+
+#ifndef BENCH_DRV_GENERIC_KEYPAD_H
+#define BENCH_DRV_GENERIC_KEYPAD_H
+
+extern int (*drv_generic_keypad_real_press) (const int num);
+
+int drv_generic_keypad_init(const char *section, const char *driver);
+void drv_generic_keypad_quit(void);
+int drv_generic_keypad_press(const int num);
+
+#endif
@@ -0,0 +1,21 @@
+/*
+ * plugin.h - stand-in for the lcd4linux header, the bench doesn't evaluate plugins
+ */
+
+#ifndef BENCH_PLUGIN_H
+#define BENCH_PLUGIN_H
+
+typedef struct {
+    int type;
+    double number;
+} RESULT;
+
+#define R_NUMBER  1
+#define R_STRING  2
+
+double R2N(RESULT * result);
+char *R2S(RESULT * result);
+void SetResult(RESULT ** result, int type, void *value);
+int AddFunction(const char *name, int args, void *function);
+
+#endif
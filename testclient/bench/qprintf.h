@@ -0,0 +1,4 @@
+/*
+ * qprintf.h - stand-in for the lcd4linux header, not used by the driver
+ */
+
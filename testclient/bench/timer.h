@@ -0,0 +1,11 @@
+/*
+ * timer.h - stand-in for the lcd4linux header, timers run by the bench between frames (see bench.c)
+ */
+
+#ifndef BENCH_TIMER_H
+#define BENCH_TIMER_H
+
+int timer_add(void (*callback) (void *data), void *data, const int interval, const int one_shot);
+int timer_remove(void (*callback) (void *data), void *data);
+
+#endif
@@ -0,0 +1,4 @@
+/*
+ * widget.h - stand-in for the lcd4linux header, the bench doesn't draw widgets
+ */
+
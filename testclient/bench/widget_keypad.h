@@ -0,0 +1,17 @@
+/*
+ * widget_keypad.h - stand-in for the lcd4linux header, keypad events of the driver
+ */
+
+#ifndef BENCH_WIDGET_KEYPAD_H
+#define BENCH_WIDGET_KEYPAD_H
+
+#define WIDGET_KEY_UP        1
+#define WIDGET_KEY_DOWN      2
+#define WIDGET_KEY_LEFT      3
+#define WIDGET_KEY_RIGHT     4
+#define WIDGET_KEY_CONFIRM   5
+#define WIDGET_KEY_CANCEL    6
+#define WIDGET_KEY_PRESSED   8
+#define WIDGET_KEY_RELEASED  16
+
+#endif
@@ -0,0 +1,69 @@
+/* Name: draw.c
+ * Project: GLCD2USB
+ * Author: Till Harbaum
+ * Licensed under GPL
+ */
+
+#include <string.h>
+#include "draw.h"
+
+/* ------------------------------------------------------------------------- */
+
+void    glcdDrawInit(glcdDraw_t *draw, usbDevice_t *device)
+{
+    draw->device = device;
+    draw->len = 1;
+    draw->bytes[0] = GLCD2USB_RID_DRAW;
+}
+
+int     glcdDrawFlush(glcdDraw_t *draw)
+{
+int     err;
+
+    if(draw->len <= 1)
+        return 0;
+    /* the zero padding ends the command list */
+    memset(draw->bytes + draw->len, 0, sizeof(draw->bytes) - draw->len);
+    err = usbSetReport(draw->device, USB_HID_REPORT_TYPE_FEATURE, draw->bytes, sizeof(draw->bytes));
+    draw->len = 1;
+    return err;
+}
+
+static int  glcdDrawAdd(glcdDraw_t *draw, int cmd, int a, int b, int c, int d)
+{
+int     err;
+
+    if(draw->len + 1 + GLCD2USB_DRAW_ARGS(cmd) > sizeof(draw->bytes) && (err = glcdDrawFlush(draw)) != 0)
+        return err;
+    draw->bytes[draw->len++] = cmd;
+    draw->bytes[draw->len++] = a;
+    draw->bytes[draw->len++] = b;
+    draw->bytes[draw->len++] = c;
+    if(GLCD2USB_DRAW_ARGS(cmd) > 3)
+        draw->bytes[draw->len++] = d;
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int     glcdDrawLine(glcdDraw_t *draw, int mode, int x1, int y1, int x2, int y2)
+{
+    return glcdDrawAdd(draw, GLCD2USB_DRAW_LINE | mode, x1, y1, x2, y2);
+}
+
+int     glcdDrawRect(glcdDraw_t *draw, int mode, int x, int y, int width, int height)
+{
+    return glcdDrawAdd(draw, GLCD2USB_DRAW_RECT | mode, x, y, width, height);
+}
+
+int     glcdDrawFill(glcdDraw_t *draw, int mode, int x, int y, int width, int height)
+{
+    return glcdDrawAdd(draw, GLCD2USB_DRAW_FILL | mode, x, y, width, height);
+}
+
+int     glcdDrawCircle(glcdDraw_t *draw, int mode, int x, int y, int radius)
+{
+    return glcdDrawAdd(draw, GLCD2USB_DRAW_CIRCLE | mode, x, y, radius, 0);
+}
+
+/* ------------------------------------------------------------------------- */
@@ -0,0 +1,55 @@
+/* Name: draw.h
+ * Project: GLCD2USB
+ * Author: Till Harbaum
+ * Licensed under GPL
+ */
+
+#ifndef __draw_h_INCLUDED__
+#define __draw_h_INCLUDED__
+
+/*
+General Description:
+This module collects drawing commands in draw reports which the GLCD2USB
+firmware executes itself. A bar graph or a gauge can then be updated with
+a few bytes instead of the pixel data of the whole area. Only displays
+reporting FLAG2_DRAW in their display info support these reports.
+*/
+
+#include "usbcalls.h"
+#include "../lcd4linux/glcd2usb.h"
+
+/* ------------------------------------------------------------------------ */
+
+typedef struct {
+    usbDevice_t     *device;
+    int             len;
+    char            bytes[GLCD2USB_DRAW_SIZE + 1];
+} glcdDraw_t;
+/* This type holds the commands not yet sent to the device.
+ */
+
+/* ------------------------------------------------------------------------ */
+
+void    glcdDrawInit(glcdDraw_t *draw, usbDevice_t *device);
+/* This function prepares 'draw' for collecting commands for 'device'.
+ */
+int     glcdDrawLine(glcdDraw_t *draw, int mode, int x1, int y1, int x2, int y2);
+int     glcdDrawRect(glcdDraw_t *draw, int mode, int x, int y, int width, int height);
+int     glcdDrawFill(glcdDraw_t *draw, int mode, int x, int y, int width, int height);
+int     glcdDrawCircle(glcdDraw_t *draw, int mode, int x, int y, int radius);
+/* These functions add a command drawing a line, the outline of a rectangle,
+ * a filled rectangle or the outline of a circle. 'mode' is one of
+ * GLCD2USB_DRAW_SET, GLCD2USB_DRAW_CLEAR or GLCD2USB_DRAW_XOR. Coordinates
+ * are taken modulo 256, dots outside the display are not drawn. If the
+ * report is full, it is sent first.
+ * Returns: 0 on success, an error code of usbSetReport() otherwise.
+ */
+int     glcdDrawFlush(glcdDraw_t *draw);
+/* This function sends the commands collected so far. The display executes
+ * the commands in the order they were added.
+ * Returns: 0 on success, an error code of usbSetReport() otherwise.
+ */
+
+/* ------------------------------------------------------------------------ */
+
+#endif /* __draw_h_INCLUDED__ */
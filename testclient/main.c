@@ -7,8 +7,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <errno.h>
 #include "usbcalls.h"
+#include "draw.h"
 
 #define IDENT_VENDOR_NUM        0x1c40
 #define IDENT_PRODUCT_NUM       0x0525
@@ -46,7 +48,8 @@ int main(int argc, char **argv)
 {
   usbDevice_t *dev = NULL;
   int         err = 0, len;
-  int bright = 0;
+  int bright = 0, flags2;
+  glcdDraw_t  draw;
 
   /* message buffer for messages going forth and back between PC and */
   /* GLCD2USB unit */
@@ -74,7 +77,8 @@ int main(int argc, char **argv)
     goto errorOccurred;
   }
 
-  if(len < sizeof(buffer.display_info)){
+  /* older firmware doesn't send the second flags byte */
+  if(len < offsetof(display_info_t, flags2)){
     fprintf(stderr, "Not enough bytes in display info report (%d instead of %d)\n", 
 	    len, (int)sizeof(buffer.display_info));
     err = -1;
@@ -84,7 +88,8 @@ int main(int argc, char **argv)
   printf("Display name: %s\n", buffer.display_info.name);
   printf("Display resolution: %d * %d\n", 
 	 buffer.display_info.width, buffer.display_info.height);
-  printf("Display flags: %x\n", buffer.display_info.flags);
+  printf("Display flags: %x %x\n", buffer.display_info.flags, buffer.display_info.flags2);
+  flags2 = buffer.display_info.flags2;
 
   /* this driver currently does not support all display memory arrangements */
   if(buffer.display_info.flags & FLAG_SIX_BIT) {
@@ -163,6 +168,18 @@ int main(int argc, char **argv)
 	  goto errorOccurred;
 	}
       }
+
+      /* the display draws a bar showing the brightness itself */
+      if(flags2 & FLAG2_DRAW) {
+	glcdDrawInit(&draw, dev);
+	glcdDrawRect(&draw, GLCD2USB_DRAW_SET, 4, 24, 120, 16);
+	glcdDrawFill(&draw, GLCD2USB_DRAW_CLEAR, 5, 25, 118, 14);
+	glcdDrawFill(&draw, GLCD2USB_DRAW_SET, 5, 25, (bright & 0xff) * 118 / 255, 14);
+	if((err = glcdDrawFlush(&draw)) != 0) {
+	  fprintf(stderr, "Error drawing brightness bar: %s\n", usbErrorMessage(err));
+	  goto errorOccurred;
+	}
+      }
     } 
 
     /* read the button state */
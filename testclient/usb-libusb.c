@@ -17,26 +17,27 @@ compatible with the Windows implementation, we add a zero report ID for all
 reports which don't have an ID. Since we don't parse the descriptor, the caller
 must tell us whether report IDs are used or not in usbOpenDevice().
 
-The implementation of dummy report IDs is a hack. Whether they are used is
-stored in a global variable, not in the device structure (just laziness, don't
-want to allocate memory for that). If you open more than one device and the
-devices differ in report ID usage, you must change the code.
+Whether dummy report IDs are used is stored with each opened device, so
+several devices differing in report ID usage can be open at the same time.
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <usb.h>
 
-#define usbDevice   usb_dev_handle  /* use libusb's device structure */
 #include "usbcalls.h"
 
+struct usbDevice{
+    usb_dev_handle  *handle;
+    int             usesReportIDs;
+};
+
 /* ------------------------------------------------------------------------- */
 
 #define USBRQ_HID_GET_REPORT    0x01
 #define USBRQ_HID_SET_REPORT    0x09
 
-static int  usesReportIDs;
-
 /* ------------------------------------------------------------------------- */
 
 static int  usbGetStringAscii(usb_dev_handle *dev, int index, int langid, char *buf, int buflen)
@@ -141,9 +142,13 @@ static int          didUsbInit = 0;
 /* Continue anyway, even if we could not claim the interface. Control transfers
  * should still work.
  */
+        if((*device = malloc(sizeof(usbDevice_t))) == NULL){
+            usb_close(handle);
+            return USB_ERROR_IO;
+        }
+        (*device)->handle = handle;
+        (*device)->usesReportIDs = _usesReportIDs;
         errorCode = 0;
-        *device = handle;
-        usesReportIDs = _usesReportIDs;
     }
     return errorCode;
 }
@@ -152,8 +157,10 @@ static int          didUsbInit = 0;
 
 void    usbCloseDevice(usbDevice_t *device)
 {
-    if(device != NULL)
-        usb_close(device);
+    if(device != NULL){
+        usb_close(device->handle);
+        free(device);
+    }
 }
 
 /* ------------------------------------------------------------------------- */
@@ -162,11 +169,11 @@ int usbSetReport(usbDevice_t *device, int reportType, char *buffer, int len)
 {
 int bytesSent;
 
-    if(!usesReportIDs){
+    if(!device->usesReportIDs){
         buffer++;   /* skip dummy report ID */
         len--;
     }
-    bytesSent = usb_control_msg(device, USB_TYPE_CLASS | USB_RECIP_INTERFACE | USB_ENDPOINT_OUT, USBRQ_HID_SET_REPORT, reportType << 8 | buffer[0], 0, buffer, len, 5000);
+    bytesSent = usb_control_msg(device->handle, USB_TYPE_CLASS | USB_RECIP_INTERFACE | USB_ENDPOINT_OUT, USBRQ_HID_SET_REPORT, reportType << 8 | buffer[0], 0, buffer, len, 5000);
     if(bytesSent != len){
         if(bytesSent < 0)
             fprintf(stderr, "Error sending message: %s\n", usb_strerror());
@@ -181,17 +188,17 @@ int usbGetReport(usbDevice_t *device, int reportType, int reportNumber, char *bu
 {
 int bytesReceived, maxLen = *len;
 
-    if(!usesReportIDs){
+    if(!device->usesReportIDs){
         buffer++;   /* make room for dummy report ID */
         maxLen--;
     }
-    bytesReceived = usb_control_msg(device, USB_TYPE_CLASS | USB_RECIP_INTERFACE | USB_ENDPOINT_IN, USBRQ_HID_GET_REPORT, reportType << 8 | reportNumber, 0, buffer, maxLen, 5000);
+    bytesReceived = usb_control_msg(device->handle, USB_TYPE_CLASS | USB_RECIP_INTERFACE | USB_ENDPOINT_IN, USBRQ_HID_GET_REPORT, reportType << 8 | reportNumber, 0, buffer, maxLen, 5000);
     if(bytesReceived < 0){
         fprintf(stderr, "Error sending message: %s\n", usb_strerror());
         return USB_ERROR_IO;
     }
     *len = bytesReceived;
-    if(!usesReportIDs){
+    if(!device->usesReportIDs){
         buffer[-1] = reportNumber;  /* add dummy report ID */
         (*len)++;
     }
@@ -0,0 +1,794 @@
+/* Name: virtual.c
+ * Project: GLCD2USB
+ * Author: Till Harbaum
+ * Licensed under GPL
+ */
+
+/*
+General Description:
+A software stand-in for a GLCD2USB device implementing the libusb 0.1 API.
+Preloading it into any libusb based client (e.g. the testclient or
+lcd4linux) makes the client see one or more virtual GLCD2USBs:
+
+  LD_PRELOAD=./libglcd2usb-virtual.so ./glcd2usb_test
+
+The transfer time of the low speed link is modeled by delaying each
+control transfer. Every device has a link of its own. The devices are found
+on bus 001 as devices 001, 002, ... with the serial numbers VIRTUAL1,
+VIRTUAL2, ... The following environment variables configure them:
+
+  GLCD2USB_DEVICES      number of devices (1)
+  GLCD2USB_TRANSFER_US  time per control transfer in us (1000)
+  GLCD2USB_BYTE_US      additional time per transferred byte in us (8)
+  GLCD2USB_SIZE         display size (128x64)
+  GLCD2USB_FLAGS        display flags reported in the display info
+  GLCD2USB_FLAGS2       second flags byte reported in the display info
+  GLCD2USB_CAPTURE      file receiving all reports in the format of the
+                        firmware simulation (ks0108/sim)
+  GLCD2USB_IMAGE        pbm file receiving the display contents on close
+  GLCD2USB_STATS        if set, print transfer statistics on close
+  GLCD2USB_UNPLUG       "after,for[,device]" in ms: the device (or all
+                        devices) disappears from the bus after the first
+                        time and comes back cleared after the second one
+  GLCD2USB_GLITCH       "after[,device]" in ms: some bytes of the display
+                        memory of the device (or all devices) get garbled
+  GLCD2USB_MEMORY       file keeping the display memory across runs, like
+                        a display staying connected while the client
+                        restarts. it is read on start and written on close
+
+A %d in the file names is replaced by the number of the device.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <usb.h>
+
+#include "../lcd4linux/glcd2usb.h"
+#include "../lcd4linux/glcd2usb_font.h"
+
+#define IDENT_VENDOR_NUM        0x1c40
+#define IDENT_PRODUCT_NUM       0x0525
+#define IDENT_VENDOR_STRING     "www.harbaum.org/till/glcd2usb"
+#define IDENT_PRODUCT_STRING    "GLCD2USB"
+
+#define USBRQ_HID_GET_REPORT    0x01
+#define USBRQ_HID_SET_REPORT    0x09
+
+#define MAX_DEVICES             16
+
+/* ------------------------------------------------------------------------- */
+
+struct usb_bus  *usb_busses = NULL;
+
+static struct usb_bus       bus;
+
+typedef struct virtual {
+    struct usb_device   device;
+    int                 number;     /* 1, 2, ... */
+    pthread_mutex_t     linkMutex;
+    FILE                *capture;
+    unsigned char       *ram;       /* written by the reports */
+    unsigned char       *panel;     /* visible, see GLCD2USB_RID_COMMIT */
+    int                 hold;
+    int                 start, nextStart;  /* display start line */
+    int                 present;    /* see GLCD2USB_UNPLUG */
+    int                 glitched;   /* see GLCD2USB_GLITCH */
+    struct {
+        unsigned long   transfers, bytes, us;
+    } stats;
+} virtual_t;
+
+/* the handles passed to the client point to these */
+static virtual_t        virtualDevice[MAX_DEVICES];
+static int              virtualDevices = 0;
+
+static int              transferUs = 1000, byteUs = 8;
+static int              width = 128, height = 64;
+static int              flags = FLAG_VERTICAL_UNITS | FLAG_BACKLIGHT | FLAG_RLE | FLAG_BUTTON_EVENTS |
+                                FLAG_MULTI;
+static int              flags2 = FLAG2_COMMIT | FLAG2_SCROLL | FLAG2_TEXT | FLAG2_DRAW | FLAG2_CRC |
+                                FLAG2_KEEP;
+static const char       *error = "";
+static struct timeval   startTime;
+static int              unplugAt = -1, unplugFor, unplugDevice;
+static int              glitchAt = -1, glitchDevice;
+
+/* ------------------------------------------------------------------------- */
+
+/* file name from the environment with the device number filled in */
+static const char   *virtualFileName(const char *variable, virtual_t *v)
+{
+static char buffer[256];
+char        *s, *d;
+
+    if((s = getenv(variable)) == NULL || (d = strstr(s, "%d")) == NULL)
+        return s;
+    snprintf(buffer, sizeof(buffer), "%.*s%d%s", (int)(d - s), s, v->number, d + 2);
+    return buffer;
+}
+
+/* the display memory file starts with the start line */
+static void virtualLoad(virtual_t *v, const char *name)
+{
+FILE    *f;
+int     c;
+
+    if((f = fopen(name, "rb")) == NULL)
+        return;             /* a new display */
+    if((c = fgetc(f)) == EOF || fread(v->ram, width * height / 8, 1, f) != 1){
+        fprintf(stderr, "virtual GLCD2USB: bad memory file '%s'\n", name);
+        memset(v->ram, 0, width * height / 8);
+    }else{
+        memcpy(v->panel, v->ram, width * height / 8);
+        v->start = v->nextStart = c % height;
+    }
+    fclose(f);
+}
+
+static void virtualSave(virtual_t *v, const char *name)
+{
+FILE    *f;
+
+    if((f = fopen(name, "wb")) == NULL){
+        perror(name);
+        return;
+    }
+    fputc(v->nextStart, f);
+    fwrite(v->ram, width * height / 8, 1, f);
+    fclose(f);
+}
+
+static void virtualInit(void)
+{
+virtual_t   *v;
+const char  *name;
+char        *s;
+int         i;
+
+    if((s = getenv("GLCD2USB_DEVICES")) == NULL || (virtualDevices = atoi(s)) < 1)
+        virtualDevices = 1;
+    if(virtualDevices > MAX_DEVICES)
+        virtualDevices = MAX_DEVICES;
+    if((s = getenv("GLCD2USB_TRANSFER_US")) != NULL)
+        transferUs = atoi(s);
+    if((s = getenv("GLCD2USB_BYTE_US")) != NULL)
+        byteUs = atoi(s);
+    if((s = getenv("GLCD2USB_SIZE")) != NULL && sscanf(s, "%dx%d", &width, &height) != 2){
+        fprintf(stderr, "virtual GLCD2USB: bad display size '%s'\n", s);
+        width = 128;
+        height = 64;
+    }
+    if((s = getenv("GLCD2USB_FLAGS")) != NULL)
+        flags = strtol(s, NULL, 0);
+    if((s = getenv("GLCD2USB_FLAGS2")) != NULL)
+        flags2 = strtol(s, NULL, 0);
+    if((s = getenv("GLCD2USB_UNPLUG")) != NULL && sscanf(s, "%d,%d,%d", &unplugAt, &unplugFor, &unplugDevice) < 2){
+        fprintf(stderr, "virtual GLCD2USB: bad unplug times '%s'\n", s);
+        unplugAt = -1;
+    }
+    if((s = getenv("GLCD2USB_GLITCH")) != NULL && sscanf(s, "%d,%d", &glitchAt, &glitchDevice) < 1){
+        fprintf(stderr, "virtual GLCD2USB: bad glitch time '%s'\n", s);
+        glitchAt = -1;
+    }
+    gettimeofday(&startTime, NULL);
+
+    strcpy(bus.dirname, "001");
+    bus.devices = &virtualDevice[0].device;
+    for(i=0;i<virtualDevices;i++){
+        v = &virtualDevice[i];
+        v->number = i + 1;
+        pthread_mutex_init(&v->linkMutex, NULL);
+        if((name = virtualFileName("GLCD2USB_CAPTURE", v)) != NULL && (v->capture = fopen(name, "w")) == NULL)
+            perror(name);
+        v->ram = calloc(width * height / 8, 1);
+        v->panel = calloc(width * height / 8, 1);
+        if((name = virtualFileName("GLCD2USB_MEMORY", v)) != NULL)
+            virtualLoad(v, name);
+        v->present = 1;
+
+        sprintf(v->device.filename, "%03d", v->number);
+        v->device.bus = &bus;
+        v->device.next = (i + 1 < virtualDevices) ? &virtualDevice[i + 1].device : NULL;
+        v->device.descriptor.idVendor = IDENT_VENDOR_NUM;
+        v->device.descriptor.idProduct = IDENT_PRODUCT_NUM;
+        v->device.descriptor.iManufacturer = 1;
+        v->device.descriptor.iProduct = 2;
+        v->device.descriptor.iSerialNumber = 3;
+    }
+    usb_busses = &bus;
+}
+
+static int  virtualTime(void)
+{
+struct timeval  now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - startTime.tv_sec) * 1000 + (now.tv_usec - startTime.tv_usec) / 1000;
+}
+
+/* is the device connected? it loses everything while it's unplugged */
+/* (link mutex held) */
+static int  virtualPresent(virtual_t *v)
+{
+int     ms, present;
+
+    if(unplugAt < 0 || (unplugDevice && v->number != unplugDevice))
+        return 1;
+    ms = virtualTime();
+    present = ms < unplugAt || ms >= unplugAt + unplugFor;
+    if(!present && v->present){
+        memset(v->ram, 0, width * height / 8);
+        memset(v->panel, 0, width * height / 8);
+        v->hold = 0;
+        v->start = v->nextStart = 0;
+    }
+    v->present = present;
+    return present;
+}
+
+/* garble the display memory once like an esd event could (link mutex held) */
+static void virtualGlitch(virtual_t *v)
+{
+int     i;
+
+    if(glitchAt < 0 || v->glitched || (glitchDevice && v->number != glitchDevice) || virtualTime() < glitchAt)
+        return;
+    for(i=v->number;i<width * height / 8;i+=211){
+        v->ram[i] ^= 0x5a;
+        v->panel[i] ^= 0x5a;
+    }
+    v->glitched = 1;
+}
+
+/* the time the low speed link would be busy with a transfer */
+static void virtualDelay(virtual_t *v, int len)
+{
+int     us = transferUs + byteUs * len;
+
+    v->stats.transfers++;
+    v->stats.bytes += len;
+    v->stats.us += us;
+    if(us > 0)
+        usleep(us);
+}
+
+static void virtualCapture(virtual_t *v, unsigned char *bytes, int len)
+{
+int     i;
+
+    if(v->capture == NULL)
+        return;
+    for(i=0;i<len;i++)
+        fprintf(v->capture, "%02x%c", bytes[i], (i == len-1)?'\n':' ');
+    fflush(v->capture);
+}
+
+static void virtualImage(virtual_t *v, const char *name)
+{
+FILE    *f;
+int     x, y;
+
+    if((f = fopen(name, "wb")) == NULL){
+        perror(name);
+        return;
+    }
+    fprintf(f, "P1\n%d %d\n", width, height);
+    for(y=0;y<height;y++){
+        for(x=0;x<width;x++)
+            fputc((v->panel[width * (((y + v->start) % height)/8) + x] & (1 << ((y + v->start)%8)))?'1':'0', f);
+        fputc('\n', f);
+    }
+    fclose(f);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int  virtualString(virtual_t *v, int index, char *bytes, int size)
+{
+const char  *s;
+char        unicode[128], serial[16];
+int         i, len;
+
+    if(index == 0){         /* language ids */
+        s = "\x09\x04";
+        len = 2;
+    }else if(index == 1){
+        s = IDENT_VENDOR_STRING;
+        len = strlen(s);
+    }else if(index == 2){
+        s = IDENT_PRODUCT_STRING;
+        len = strlen(s);
+    }else if(index == 3){
+        sprintf(serial, "VIRTUAL%d", v->number);
+        s = serial;
+        len = strlen(s);
+    }else{
+        error = "invalid string index";
+        return -EPIPE;
+    }
+    if(index){              /* ascii to 16 bit unicode */
+        for(i=0;i<len;i++){
+            unicode[2*i] = s[i];
+            unicode[2*i+1] = 0;
+        }
+        s = unicode;
+        len *= 2;
+    }
+    if(len + 2 > size)
+        len = size - 2;
+    bytes[0] = len + 2;
+    bytes[1] = USB_DT_STRING;
+    memcpy(bytes + 2, s, len);
+    return len + 2;
+}
+
+static int  virtualGetReport(virtual_t *v, int id, unsigned char *bytes, int size)
+{
+display_info_t  info;
+unsigned short  crc;
+int             i, k;
+
+    switch(id){
+    case GLCD2USB_RID_GET_INFO:
+        memset(&info, 0, sizeof(info));
+        info.report_id = GLCD2USB_RID_GET_INFO;
+        strcpy(info.name, "virtual");
+        info.width = width;
+        info.height = height;
+        info.flags = flags;
+        info.flags2 = flags2;
+        if(size > (int)sizeof(info))
+            size = sizeof(info);
+        memcpy(bytes, &info, size);
+        return size;
+    case GLCD2USB_RID_GET_BUTTONS:
+        if(size < 2)
+            break;
+        bytes[0] = GLCD2USB_RID_GET_BUTTONS;
+        bytes[1] = 0;       /* no buttons pressed */
+        return 2;
+    case GLCD2USB_RID_GET_CRC:
+        if(size < 1 + 2 * GLCD2USB_CRC_PAGES)
+            break;
+        if(v->capture != NULL){
+            fprintf(v->capture, "< %02x\n", id);
+            fflush(v->capture);
+        }
+        memset(bytes, 0, 1 + 2 * GLCD2USB_CRC_PAGES);
+        bytes[0] = GLCD2USB_RID_GET_CRC;
+        for(k=0;k<GLCD2USB_CRC_PAGES && k * GLCD2USB_CRC_PAGE < width * height / 8;k++){
+            crc = 0xffff;
+            for(i=k * GLCD2USB_CRC_PAGE;i<(k + 1) * GLCD2USB_CRC_PAGE && i < width * height / 8;i++)
+                crc = glcd2usb_crc(crc, v->ram[i]);
+            bytes[1 + 2 * k] = crc & 0xff;
+            bytes[2 + 2 * k] = crc >> 8;
+        }
+        return 1 + 2 * GLCD2USB_CRC_PAGES;
+    }
+    error = "unsupported report";
+    return -EPIPE;
+}
+
+/* decode a write report into the display memory */
+static int  virtualWrite(virtual_t *v, unsigned char *bytes, int len, int allowed)
+{
+unsigned char   *ram = v->ram;
+int     offset = bytes[1] + 256 * bytes[2], n = bytes[3], i, c, k;
+
+    if(len != allowed + 4 || n > allowed){
+        fprintf(stderr, "virtual GLCD2USB: bad write report (id %d, %d bytes, length %d)\n",
+                bytes[0], len, n);
+        return -1;
+    }
+    if(bytes[0] >= GLCD2USB_RID_WRITE_RLE){     /* decode rle chunks */
+        for(i=0;i<n;){
+            c = bytes[4+i];
+            k = (c & ~GLCD2USB_RLE_REPEAT) + 1;
+            if(offset + k > width * height / 8)
+                return -1;
+            if(c & GLCD2USB_RLE_REPEAT){
+                memset(ram + offset, bytes[5+i], k);
+                i += 2;
+            }else{
+                memcpy(ram + offset, bytes + 5 + i, k);
+                i += k + 1;
+            }
+            offset += k;
+        }
+    }else{
+        if(offset + n > width * height / 8)
+            return -1;
+        memcpy(ram + offset, bytes + 4, n);
+    }
+    return 0;
+}
+
+/* decode the segments of a multi write or text report into the display memory */
+static int  virtualWriteMulti(virtual_t *v, unsigned char *bytes, int len, int allowed, int text)
+{
+unsigned char   *ram = v->ram;
+int     i, j, c, offset, n, unit = text ? GLCD2USB_TEXT_WIDTH : 1;
+
+    if(len != allowed + 4){
+        fprintf(stderr, "virtual GLCD2USB: bad multi write report (id %d, %d bytes)\n",
+                bytes[0], len);
+        return -1;
+    }
+    for(i=1;i + GLCD2USB_MULTI_HEADER <= len && bytes[i+2];i += GLCD2USB_MULTI_HEADER + n){
+        offset = bytes[i] + 256 * bytes[i+1];
+        n = bytes[i+2];
+        if(i + GLCD2USB_MULTI_HEADER + n > len || offset + n * unit > width * height / 8)
+            return -1;
+        if(!text){
+            memcpy(ram + offset, bytes + i + GLCD2USB_MULTI_HEADER, n);
+            continue;
+        }
+        for(j=0;j<n;j++){   /* draw characters like the firmware does */
+            c = bytes[i + GLCD2USB_MULTI_HEADER + j] - GLCD2USB_FONT_FIRST;
+            if(c < 0 || c >= GLCD2USB_FONT_CHARS)
+                c = 0;
+            memcpy(ram + offset + j * unit, glcd2usb_font[c], 5);
+            ram[offset + j * unit + 5] = 0;
+        }
+    }
+    return 0;
+}
+
+/* the drawing primitives below produce the same dots as the ones of */
+/* the firmware (ks0108/glcd.c), incl. its 8 bit coordinate arithmetic */
+static void virtualDot(virtual_t *v, unsigned char x, unsigned char y, int mode)
+{
+unsigned char   *p, bit;
+
+    if(x >= width || y >= height)
+        return;
+    p = v->ram + (y / 8) * width + x;
+    bit = 1 << (y % 8);
+    if(mode == GLCD2USB_DRAW_CLEAR)
+        *p &= ~bit;
+    else if(mode == GLCD2USB_DRAW_XOR)
+        *p ^= bit;
+    else
+        *p |= bit;
+}
+
+static void virtualLine(virtual_t *v, unsigned char x1, unsigned char y1, unsigned char x2, unsigned char y2, int mode)
+{
+int     dx = x2 - x1, dy = y2 - y1, inx = dx > 0 ? 1 : -1, iny = dy > 0 ? 1 : -1, e;
+
+    dx = (dx > 0) ? dx : -dx;
+    dy = (dy > 0) ? dy : -dy;
+    if(dx >= dy){
+        dy <<= 1;
+        e = dy - dx;
+        dx <<= 1;
+        while(x1 != x2){
+            virtualDot(v, x1, y1, mode);
+            if(e >= 0){
+                y1 += iny;
+                e -= dx;
+            }
+            e += dy; x1 += inx;
+        }
+    }else{
+        dx <<= 1;
+        e = dx - dy;
+        dy <<= 1;
+        while(y1 != y2){
+            virtualDot(v, x1, y1, mode);
+            if(e >= 0){
+                x1 += inx;
+                e -= dy;
+            }
+            e += dx; y1 += iny;
+        }
+    }
+    virtualDot(v, x1, y1, mode);
+}
+
+static void virtualRect(virtual_t *v, unsigned char x, unsigned char y, unsigned char w, unsigned char h, int mode)
+{
+unsigned char   j;
+
+    if(!w || !h)
+        return;
+    for(j=0;j<h;j++){
+        virtualDot(v, x, y + j, mode);
+        if(w > 1)
+            virtualDot(v, x + w - 1, y + j, mode);
+    }
+    for(j=1;j<w-1;j++){
+        virtualDot(v, x + j, y, mode);
+        if(h > 1)
+            virtualDot(v, x + j, y + h - 1, mode);
+    }
+}
+
+static void virtualCirclePoints(virtual_t *v, unsigned char xc, unsigned char yc, unsigned char x, unsigned char y, int mode)
+{
+    virtualDot(v, xc + x, yc + y, mode);
+    if(x) virtualDot(v, xc - x, yc + y, mode);
+    if(y) virtualDot(v, xc + x, yc - y, mode);
+    if(x && y) virtualDot(v, xc - x, yc - y, mode);
+}
+
+static void virtualCircle(virtual_t *v, unsigned char xc, unsigned char yc, unsigned char r, int mode)
+{
+int     t = 3 - 2 * r, x = 0, y = r;
+
+    while(x <= y){
+        virtualCirclePoints(v, xc, yc, x, y, mode);
+        if(x != y)
+            virtualCirclePoints(v, xc, yc, y, x, mode);
+        if(t < 0){
+            t += 4 * x + 6;
+        }else{
+            t += 4 * (x - y) + 10;
+            y--;
+        }
+        x++;
+    }
+}
+
+/* execute the commands of a draw report */
+static int  virtualDraw(virtual_t *v, unsigned char *bytes, int len)
+{
+int     i, x, y, c, mode;
+unsigned char   *a;
+
+    if(len != GLCD2USB_DRAW_SIZE + 1){
+        fprintf(stderr, "virtual GLCD2USB: bad draw report (%d bytes)\n", len);
+        return -1;
+    }
+    for(i=1;i < len && bytes[i];i += 1 + GLCD2USB_DRAW_ARGS(c)){
+        c = bytes[i];
+        mode = c & GLCD2USB_DRAW_MODE;
+        a = bytes + i + 1;
+        if(i + GLCD2USB_DRAW_ARGS(c) >= len)
+            break;      /* incomplete command in the padding */
+        switch(c & GLCD2USB_DRAW_PRIMITIVE){
+        case GLCD2USB_DRAW_LINE:
+            virtualLine(v, a[0], a[1], a[2], a[3], mode);
+            break;
+        case GLCD2USB_DRAW_RECT:
+            virtualRect(v, a[0], a[1], a[2], a[3], mode);
+            break;
+        case GLCD2USB_DRAW_FILL:
+            for(x=a[0];x < a[0] + a[2] && x < width;x++)
+                for(y=a[1];y < a[1] + a[3] && y < height;y++)
+                    virtualDot(v, x, y, mode);
+            break;
+        case GLCD2USB_DRAW_CIRCLE:
+            virtualCircle(v, a[0], a[1], a[2], mode);
+            break;
+        default:
+            return 0;   /* ends the command list like in the firmware */
+        }
+    }
+    return 0;
+}
+
+/* make the written data visible unless frames are held back */
+static int  virtualShow(virtual_t *v, int len)
+{
+    if(!v->hold){
+        memcpy(v->panel, v->ram, width * height / 8);
+        v->start = v->nextStart;
+    }
+    return len;
+}
+
+static int  virtualSetReport(virtual_t *v, unsigned char *bytes, int len)
+{
+int     id = bytes[0];
+
+    virtualCapture(v, bytes, len);
+
+    if(id >= GLCD2USB_RID_WRITE_4 && id <= GLCD2USB_RID_WRITE_128){
+        if(virtualWrite(v, bytes, len, 4 << (id - GLCD2USB_RID_WRITE)) == 0)
+            return virtualShow(v, len);
+    }else if(id == GLCD2USB_RID_WRITE_RLE_16 || id == GLCD2USB_RID_WRITE_RLE_64){
+        if(virtualWrite(v, bytes, len, (id == GLCD2USB_RID_WRITE_RLE_16)?16:64) == 0)
+            return virtualShow(v, len);
+    }else if(id == GLCD2USB_RID_WRITE_MULTI_64 || id == GLCD2USB_RID_WRITE_MULTI_128){
+        if(virtualWriteMulti(v, bytes, len, (id == GLCD2USB_RID_WRITE_MULTI_64)?64:128, 0) == 0)
+            return virtualShow(v, len);
+    }else if(id == GLCD2USB_RID_DRAW && (flags2 & FLAG2_DRAW)){
+        if(virtualDraw(v, bytes, len) == 0)
+            return virtualShow(v, len);
+    }else if(id == GLCD2USB_RID_TEXT && (flags2 & FLAG2_TEXT)){
+        if(virtualWriteMulti(v, bytes, len, 64, 1) == 0)
+            return virtualShow(v, len);
+    }else if(id == GLCD2USB_RID_SET_ALLOC && len == 2){
+        if(!(bytes[1] & GLCD2USB_ALLOC_KEEP) || !(flags2 & FLAG2_KEEP)){
+            memset(v->ram, 0, width * height / 8);    /* the firmware clears the display */
+            v->nextStart = 0;
+        }
+        v->hold = 0;
+        return virtualShow(v, len);
+    }else if(id == GLCD2USB_RID_COMMIT && len == 2 && (flags2 & FLAG2_COMMIT)){
+        v->hold = 0;
+        virtualShow(v, len);
+        v->hold = bytes[1];
+        return len;
+    }else if(id == GLCD2USB_RID_SCROLL && len == 2 && (flags2 & FLAG2_SCROLL)){
+        v->nextStart = bytes[1] % height;
+        return virtualShow(v, len);
+    }else if(id == GLCD2USB_RID_SET_BL && len == 2){
+        return len;
+    }else if(id == GLCD2USB_RID_GET_CRC && len == 1 && (flags2 & FLAG2_CRC)){
+        return len;     /* the crcs are computed when they're fetched */
+    }
+    error = "unsupported report";
+    return -EPIPE;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ libusb api ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+void    usb_init(void)
+{
+    if(!virtualDevices)
+        virtualInit();
+}
+
+void    usb_set_debug(int level)
+{
+}
+
+int usb_find_busses(void)
+{
+    usb_init();
+    return 1;
+}
+
+int usb_find_devices(void)
+{
+struct usb_device   **next = &bus.devices;
+virtual_t           *v;
+int                 i;
+
+    for(i=0;i<virtualDevices;i++){
+        v = &virtualDevice[i];
+        pthread_mutex_lock(&v->linkMutex);
+        if(virtualPresent(v)){
+            *next = &v->device;
+            next = &v->device.next;
+        }
+        pthread_mutex_unlock(&v->linkMutex);
+    }
+    *next = NULL;
+    return 1;
+}
+
+struct usb_bus  *usb_get_busses(void)
+{
+    return usb_busses;
+}
+
+usb_dev_handle  *usb_open(struct usb_device *dev)
+{
+int     i;
+
+    for(i=0;i<virtualDevices;i++)
+        if(dev == &virtualDevice[i].device)
+            return (usb_dev_handle *)&virtualDevice[i];
+    error = "no such device";
+    return NULL;
+}
+
+/* closing NULL writes the images and statistics of all devices */
+int usb_close(usb_dev_handle *dev)
+{
+virtual_t   *v;
+const char  *name;
+int         i;
+
+    for(i=0;i<virtualDevices;i++){
+        v = &virtualDevice[i];
+        if(dev != NULL && dev != (usb_dev_handle *)v)
+            continue;
+        if((name = virtualFileName("GLCD2USB_IMAGE", v)) != NULL)
+            virtualImage(v, name);
+        if((name = virtualFileName("GLCD2USB_MEMORY", v)) != NULL)
+            virtualSave(v, name);
+        if(getenv("GLCD2USB_STATS") != NULL)
+            fprintf(stderr, "virtual GLCD2USB %d: %lu transfers, %lu bytes, %lu.%03lu s link time\n", v->number,
+                    v->stats.transfers, v->stats.bytes, v->stats.us / 1000000, (v->stats.us / 1000) % 1000);
+    }
+    return 0;
+}
+
+struct usb_device   *usb_device(usb_dev_handle *dev)
+{
+    return &((virtual_t *)dev)->device;
+}
+
+int usb_set_configuration(usb_dev_handle *dev, int configuration)
+{
+    return 0;
+}
+
+int usb_claim_interface(usb_dev_handle *dev, int interface)
+{
+    return 0;
+}
+
+int usb_release_interface(usb_dev_handle *dev, int interface)
+{
+    return 0;
+}
+
+int usb_detach_kernel_driver_np(usb_dev_handle *dev, int interface)
+{
+    return 0;
+}
+
+char    *usb_strerror(void)
+{
+    return (char *)error;
+}
+
+int usb_get_string_simple(usb_dev_handle *dev, int index, char *buf, size_t buflen)
+{
+char    buffer[256];
+int     len, i;
+
+    if((len = virtualString((virtual_t *)dev, index, buffer, sizeof(buffer))) < 0)
+        return len;
+    for(i=0;2*i+2 < len && i < (int)buflen-1;i++)
+        buf[i] = buffer[2*i+2];
+    buf[i] = 0;
+    return i;
+}
+
+int usb_control_msg(usb_dev_handle *dev, int requesttype, int request, int value, int index, char *bytes, int size, int timeout)
+{
+virtual_t   *v = (virtual_t *)dev;
+int         rval = -EPIPE;
+
+    pthread_mutex_lock(&v->linkMutex);
+    if(!virtualPresent(v)){
+        pthread_mutex_unlock(&v->linkMutex);
+        error = "no such device";
+        return -ENODEV;
+    }
+    virtualGlitch(v);
+    if(requesttype == USB_ENDPOINT_IN && request == USB_REQ_GET_DESCRIPTOR && (value >> 8) == USB_DT_STRING){
+        rval = virtualString(v, value & 0xff, bytes, size);
+    }else if((requesttype & (0x03 << 5)) == USB_TYPE_CLASS){
+        if(request == USBRQ_HID_GET_REPORT)
+            rval = virtualGetReport(v, value & 0xff, (unsigned char *)bytes, size);
+        else if(request == USBRQ_HID_SET_REPORT && size > 0)
+            rval = virtualSetReport(v, (unsigned char *)bytes, size);
+    }else{
+        error = "unsupported request";
+    }
+    virtualDelay(v, size);
+    pthread_mutex_unlock(&v->linkMutex);
+    return rval;
+}
+
+int usb_interrupt_read(usb_dev_handle *dev, int ep, char *bytes, int size, int timeout)
+{
+virtual_t   *v = (virtual_t *)dev;
+int         present;
+
+    pthread_mutex_lock(&v->linkMutex);
+    present = virtualPresent(v);
+    pthread_mutex_unlock(&v->linkMutex);
+    if(!present){
+        error = "no such device";
+        return -ENODEV;
+    }
+    /* buttons never change */
+    usleep(1000 * timeout);
+    error = "timeout";
+    return -ETIMEDOUT;
+}